@@ -0,0 +1,409 @@
+// Writes a synthetic .cy source file for benchmarking the lexer.
+//
+//   corpus <mix> <size> <output> [seed]
+//
+// `size` is in bytes and takes a K, M or G suffix. The mix picks what the
+// functions are mostly made of:
+//
+//   ident     long names, calls and member accesses
+//   operator  dense arithmetic, comparison and assignment expressions
+//   comment   line comments and commented-out code
+//   literal   integer, float, string and character literals
+//   mixed     a balance of all of the above
+//
+// The output is deterministic for a given seed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+typedef u8 Mix;
+enum {
+    MIX_IDENT,
+    MIX_OPERATOR,
+    MIX_COMMENT,
+    MIX_LITERAL,
+    MIX_MIXED,
+    MIX_COUNT,
+};
+
+static const char *mix_names[MIX_COUNT] = {
+    "ident", "operator", "comment", "literal", "mixed",
+};
+
+// Relative weights of each kind of statement, per mix.
+typedef u8 Stmt;
+enum {
+    STMT_LET,
+    STMT_CALL,
+    STMT_ASSIGN,
+    STMT_IF,
+    STMT_FOR,
+    STMT_THROW,
+    STMT_COMMENT,
+    STMT_LITERALS,
+    STMT_COUNT,
+};
+
+static const u32 mix_weights[MIX_COUNT][STMT_COUNT] = {
+    [MIX_IDENT] = {30, 40, 10, 5, 5, 2, 3, 5},
+    [MIX_OPERATOR] = {15, 5, 45, 20, 5, 2, 3, 5},
+    [MIX_COMMENT] = {5, 5, 5, 3, 2, 1, 75, 4},
+    [MIX_LITERAL] = {15, 5, 5, 3, 2, 10, 3, 57},
+    [MIX_MIXED] = {20, 15, 15, 10, 8, 4, 14, 14},
+};
+
+static const char *words[] = {
+    "data",  "len",   "index",  "count",  "buffer", "str",   "cstr",
+    "value", "node",  "next",   "result", "size",   "offset", "token",
+    "file",  "line",  "column", "symbol", "scope",  "parent", "left",
+    "right", "key",   "entry",  "slot",   "hash",   "state", "cursor",
+};
+#define WORD_COUNT (sizeof(words) / sizeof(words[0]))
+
+static const char *types[] = {
+    "uint", "int", "bool", "rune", "*c_char", "*void", "String", "f64",
+};
+#define TYPE_COUNT (sizeof(types) / sizeof(types[0]))
+
+static const char *binary_ops[] = {
+    "+", "-", "*", "/", "%", "==", "!=", "<", "<=", ">", ">=", "&&", "||",
+    "&", "|", "^", "<<", ">>",
+};
+#define BINARY_OP_COUNT (sizeof(binary_ops) / sizeof(binary_ops[0]))
+
+static const char *assign_ops[] = {"=", "+=", "-=", "*=", "/=", "%="};
+#define ASSIGN_OP_COUNT (sizeof(assign_ops) / sizeof(assign_ops[0]))
+
+static const char *comment_words[] = {
+    "TODO:", "this", "should", "probably", "handle", "the", "case", "where",
+    "we",    "run",  "out",    "of",       "memory", "a",   "for",  "now",
+};
+#define COMMENT_WORD_COUNT (sizeof(comment_words) / sizeof(comment_words[0]))
+
+typedef struct {
+    FILE *out;
+    Mix mix;
+    u64 rng;
+    usize written;
+    u32 total_weight;
+} Gen;
+
+static u32 gen_rand(Gen *gen, u32 n) {
+    gen->rng ^= gen->rng << 13;
+    gen->rng ^= gen->rng >> 7;
+    gen->rng ^= gen->rng << 17;
+    return (u32)((gen->rng >> 32) % n);
+}
+
+static void gen_write(Gen *gen, const char *s) {
+    usize len = strlen(s);
+    fwrite(s, 1, len, gen->out);
+    gen->written += len;
+}
+
+static void gen_printf(Gen *gen, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vfprintf(gen->out, fmt, args);
+    va_end(args);
+    gen->written += (usize)n;
+}
+
+static void gen_indent(Gen *gen, u32 depth) {
+    for (u32 i = 0; i < depth; i++)
+        gen_write(gen, "    ");
+}
+
+static void gen_ident(Gen *gen) {
+    gen_write(gen, words[gen_rand(gen, WORD_COUNT)]);
+    // Identifier-heavy code favours long, compound names.
+    u32 parts = gen->mix == MIX_IDENT ? gen_rand(gen, 4) : gen_rand(gen, 2);
+    for (u32 i = 0; i < parts; i++) {
+        gen_write(gen, "_");
+        gen_write(gen, words[gen_rand(gen, WORD_COUNT)]);
+    }
+    if (gen_rand(gen, 4) == 0)
+        gen_printf(gen, "%u", gen_rand(gen, 100));
+}
+
+static void gen_literal(Gen *gen) {
+    switch (gen_rand(gen, 5)) {
+    case 0:
+        gen_printf(gen, "%u", gen_rand(gen, 1000));
+        break;
+    case 1:
+        gen_printf(gen, "%u%u", gen_rand(gen, 100000), gen_rand(gen, 100000));
+        break;
+    case 2:
+        gen_printf(gen, "%u.%u", gen_rand(gen, 10000), gen_rand(gen, 100000));
+        break;
+    case 3: {
+        static const char *strings[] = {
+            "\"hi\"",
+            "\"index out of bounds\"",
+            "\"{}\\n\"",
+            "\"non-ascii character in string\"",
+            "\"tab\\tseparated\\tvalues\"",
+            "\"quote \\\"inside\\\" string\"",
+            "\"caf\xc3\xa9\"",
+        };
+        gen_write(gen, strings[gen_rand(gen, 7)]);
+        break;
+    }
+    default: {
+        static const char *chars[] = {"'a'", "'\\0'", "'\\n'", "'z'", "'\\''"};
+        gen_write(gen, chars[gen_rand(gen, 5)]);
+        break;
+    }
+    }
+}
+
+static void gen_operand(Gen *gen) {
+    u32 literal_odds = gen->mix == MIX_LITERAL ? 2 : 4;
+    if (gen_rand(gen, literal_odds) == 0) {
+        gen_literal(gen);
+    } else {
+        gen_ident(gen);
+        if (gen->mix == MIX_IDENT && gen_rand(gen, 3) == 0) {
+            gen_write(gen, ".");
+            gen_ident(gen);
+        }
+    }
+}
+
+static void gen_expr(Gen *gen, u32 depth) {
+    u32 terms = gen->mix == MIX_OPERATOR ? 2 + gen_rand(gen, 5)
+                                         : 1 + gen_rand(gen, 3);
+    for (u32 i = 0; i < terms; i++) {
+        if (i > 0)
+            gen_printf(gen, " %s ", binary_ops[gen_rand(gen, BINARY_OP_COUNT)]);
+        if (depth < 2 && gen_rand(gen, 6) == 0) {
+            gen_write(gen, "(");
+            gen_expr(gen, depth + 1);
+            gen_write(gen, ")");
+        } else {
+            if (gen->mix == MIX_OPERATOR && gen_rand(gen, 5) == 0)
+                gen_write(gen, gen_rand(gen, 2) ? "-" : "!");
+            gen_operand(gen);
+        }
+    }
+}
+
+static void gen_call(Gen *gen) {
+    gen_ident(gen);
+    if (gen_rand(gen, 2) == 0) {
+        gen_write(gen, ".");
+        gen_ident(gen);
+    }
+    gen_write(gen, "(");
+    u32 args = gen_rand(gen, 4);
+    for (u32 i = 0; i < args; i++) {
+        if (i > 0)
+            gen_write(gen, ", ");
+        gen_expr(gen, 1);
+    }
+    gen_write(gen, ")");
+}
+
+static void gen_comment(Gen *gen) {
+    gen_write(gen, "//");
+    u32 n = 4 + gen_rand(gen, 12);
+    for (u32 i = 0; i < n; i++) {
+        gen_write(gen, " ");
+        gen_write(gen, comment_words[gen_rand(gen, COMMENT_WORD_COUNT)]);
+    }
+}
+
+static void gen_block(Gen *gen, u32 depth);
+
+static void gen_stmt(Gen *gen, u32 depth) {
+    u32 pick = gen_rand(gen, gen->total_weight);
+    Stmt stmt = 0;
+    while (pick >= mix_weights[gen->mix][stmt])
+        pick -= mix_weights[gen->mix][stmt++];
+    // Nested blocks only go a few levels deep, like real code.
+    if (depth >= 3 && (stmt == STMT_IF || stmt == STMT_FOR))
+        stmt = STMT_ASSIGN;
+
+    gen_indent(gen, depth);
+    switch (stmt) {
+    case STMT_LET:
+        gen_write(gen, "let ");
+        gen_ident(gen);
+        if (gen_rand(gen, 2) == 0) {
+            gen_write(gen, " := ");
+        } else {
+            gen_printf(gen, " %s = ", types[gen_rand(gen, TYPE_COUNT)]);
+        }
+        gen_expr(gen, 0);
+        gen_write(gen, ";");
+        break;
+    case STMT_CALL:
+        if (gen_rand(gen, 3) == 0)
+            gen_write(gen, "let result := try ");
+        gen_call(gen);
+        gen_write(gen, ";");
+        break;
+    case STMT_ASSIGN:
+        gen_ident(gen);
+        gen_printf(gen, " %s ", assign_ops[gen_rand(gen, ASSIGN_OP_COUNT)]);
+        gen_expr(gen, 0);
+        gen_write(gen, gen_rand(gen, 8) == 0 ? "++;" : ";");
+        break;
+    case STMT_IF:
+        gen_write(gen, "if ");
+        gen_expr(gen, 0);
+        gen_write(gen, " {\n");
+        gen_block(gen, depth + 1);
+        gen_indent(gen, depth);
+        if (gen_rand(gen, 3) == 0) {
+            gen_write(gen, "} else {\n");
+            gen_block(gen, depth + 1);
+            gen_indent(gen, depth);
+        }
+        gen_write(gen, "}");
+        break;
+    case STMT_FOR:
+        gen_write(gen, "for ");
+        gen_ident(gen);
+        gen_write(gen, " in 0..");
+        gen_operand(gen);
+        gen_write(gen, " {\n");
+        gen_block(gen, depth + 1);
+        gen_indent(gen, depth);
+        gen_write(gen, "}");
+        break;
+    case STMT_THROW:
+        gen_write(gen, "throw ");
+        gen_literal(gen);
+        gen_write(gen, " if ");
+        gen_expr(gen, 0);
+        gen_write(gen, ";");
+        break;
+    case STMT_COMMENT:
+        gen_comment(gen);
+        break;
+    default:
+        gen_write(gen, "print(");
+        gen_literal(gen);
+        gen_write(gen, ", .{");
+        for (u32 i = 0, n = 1 + gen_rand(gen, 4); i < n; i++) {
+            if (i > 0)
+                gen_write(gen, ", ");
+            gen_literal(gen);
+        }
+        gen_write(gen, "});");
+        break;
+    }
+    if (stmt != STMT_COMMENT && gen_rand(gen, 10) == 0) {
+        gen_write(gen, " ");
+        gen_comment(gen);
+    }
+    gen_write(gen, "\n");
+}
+
+static void gen_block(Gen *gen, u32 depth) {
+    u32 n = 1 + gen_rand(gen, depth > 1 ? 3 : 6);
+    for (u32 i = 0; i < n; i++)
+        gen_stmt(gen, depth);
+}
+
+static void gen_struct(Gen *gen) {
+    gen_write(gen, "struct ");
+    gen_ident(gen);
+    gen_write(gen, " {\n");
+    for (u32 i = 0, n = 1 + gen_rand(gen, 4); i < n; i++) {
+        gen_indent(gen, 1);
+        gen_ident(gen);
+        gen_printf(gen, " %s\n", types[gen_rand(gen, TYPE_COUNT)]);
+    }
+    gen_write(gen, "}\n\n");
+}
+
+static void gen_fn(Gen *gen) {
+    gen_write(gen, "fn ");
+    gen_ident(gen);
+    gen_write(gen, "(");
+    for (u32 i = 0, n = gen_rand(gen, 4); i < n; i++) {
+        if (i > 0)
+            gen_write(gen, ", ");
+        gen_ident(gen);
+        gen_printf(gen, " %s", types[gen_rand(gen, TYPE_COUNT)]);
+    }
+    gen_printf(gen, ") %s%s {\n", gen_rand(gen, 2) ? "!" : "",
+               types[gen_rand(gen, TYPE_COUNT)]);
+    gen_block(gen, 1);
+    gen_indent(gen, 1);
+    gen_write(gen, "return ");
+    gen_expr(gen, 0);
+    gen_write(gen, ";\n}\n\n");
+}
+
+static bool parse_size(const char *s, usize *out) {
+    char *end;
+    unsigned long long n = strtoull(s, &end, 10);
+    switch (*end) {
+    case 'G':
+    case 'g':
+        n *= 1024;
+        // fallthrough
+    case 'M':
+    case 'm':
+        n *= 1024;
+        // fallthrough
+    case 'K':
+    case 'k':
+        n *= 1024;
+        end++;
+        break;
+    }
+    *out = (usize)n;
+    return *end == '\0' && end != s && n > 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 4 || argc > 5) {
+        fprintf(stderr, "usage: %s <mix> <size> <output> [seed]\n", argv[0]);
+        return 1;
+    }
+
+    Gen gen = {0};
+    gen.mix = MIX_COUNT;
+    for (Mix m = 0; m < MIX_COUNT; m++)
+        if (strcmp(argv[1], mix_names[m]) == 0)
+            gen.mix = m;
+    if (gen.mix == MIX_COUNT) {
+        fprintf(stderr, "error: unknown mix '%s'\n", argv[1]);
+        return 1;
+    }
+    for (Stmt s = 0; s < STMT_COUNT; s++)
+        gen.total_weight += mix_weights[gen.mix][s];
+
+    usize size;
+    if (!parse_size(argv[2], &size)) {
+        fprintf(stderr, "error: invalid size '%s'\n", argv[2]);
+        return 1;
+    }
+
+    gen.rng = argc == 5 ? strtoull(argv[4], NULL, 10) : 0x2545F4914F6CDD1Dull;
+    if (gen.rng == 0)
+        gen.rng = 1;
+
+    gen.out = fopen(argv[3], "wb");
+    if (gen.out == NULL) {
+        fprintf(stderr, "error: could not open file '%s'\n", argv[3]);
+        return 1;
+    }
+
+    while (gen.written < size) {
+        if (gen_rand(&gen, 8) == 0)
+            gen_struct(&gen);
+        else
+            gen_fn(&gen);
+    }
+    fclose(gen.out);
+    return 0;
+}
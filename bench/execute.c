@@ -0,0 +1,172 @@
+// Times vm_execute over a synthetic program and reports how many
+// instructions it dispatches per second.
+//
+//   bench-vm [--runs N] [--size N] [--trace N]
+//
+// The program is N instructions (default 1M) of moves, arithmetic, pushes,
+// pops and forward jumps in a random but fixed order, so consecutive
+// handlers rarely repeat, followed by a HLT. It is run N times (default 5)
+// and the fastest run is reported. --trace records the last N instructions
+// while it runs, to measure what tracing costs.
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common.h"
+#include "intern.h"
+#include "vm.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// Registers the program uses; all of them are set before the first use.
+#define BENCH_REGISTERS 8
+
+static double bench_now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+// The program repeats a block of this many random instructions, like an
+// unrolled loop, so the branch predictor has a pattern to learn.
+#define BENCH_BLOCK 256
+
+static u32 bench_seed = 12345;
+
+static u32 bench_random(u32 n) {
+    bench_seed = bench_seed * 1664525 + 1013904223;
+    return (bench_seed >> 8) % n;
+}
+
+static void bench_build(VirtualMachine *vm, Interner *symbols, usize size) {
+    for (u8 r = 0; r < BENCH_REGISTERS; r++)
+        vm_emit(vm, MOV(REG_VALUE(r), IMM_VALUE(r + 1)));
+
+    usize labels = 0;
+    usize block_end = 0;
+    char name[32];
+    for (usize i = BENCH_REGISTERS; i + 1 < size;) {
+        if (i >= block_end) {
+            bench_seed = 12345;
+            block_end = i + BENCH_BLOCK;
+        }
+        Register a = (Register)bench_random(BENCH_REGISTERS);
+        Register b = (Register)bench_random(BENCH_REGISTERS);
+        switch (bench_random(9)) {
+        case 0: {
+            vm_emit(vm, MOV(REG_VALUE(a), IMM_VALUE(bench_random(100))));
+        } break;
+        case 1: {
+            vm_emit(vm, MOV(REG_VALUE(a), REG_VALUE(b)));
+        } break;
+        case 2: {
+            vm_emit(vm, ADD(REG_VALUE(a), IMM_VALUE(3)));
+        } break;
+        case 3: {
+            vm_emit(vm, SUB(REG_VALUE(a), REG_VALUE(b)));
+        } break;
+        case 4: {
+            vm_emit(vm, MUL(REG_VALUE(a), IMM_VALUE(0.5)));
+        } break;
+        case 5: {
+            vm_emit(vm, DIV(REG_VALUE(a), IMM_VALUE(2)));
+        } break;
+        case 6: {
+            vm_emit(vm, MOD(REG_VALUE(a), IMM_VALUE(7)));
+        } break;
+        case 7: {
+            if (i + 2 >= size)
+                continue;
+            vm_emit(vm, PUSH(REG_VALUE(a)));
+            vm_emit(vm, POP(REG_VALUE(b)));
+            i++;
+        } break;
+        case 8: {
+            // Jump over nothing, to exercise the jump handler.
+            snprintf(name, sizeof(name), "l%zu", labels++);
+            Symbol label = intern(symbols, SV(name));
+            vm_emit(vm, JMP(LABEL_VALUE(label)));
+            vm_emit_label(vm, interner_get(symbols, label));
+        } break;
+        }
+        i++;
+    }
+    vm_emit(vm, HLT());
+}
+
+int main(int argc, char **argv) {
+    usize runs = 5;
+    usize size = 1000000;
+    usize trace = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            size = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace = strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--runs N] [--size N] [--trace N]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (runs == 0 || size <= BENCH_REGISTERS) {
+        fprintf(stderr, "usage: %s [--runs N] [--size N] [--trace N]\n",
+                argv[0]);
+        return 1;
+    }
+
+    Interner symbols;
+    interner_init(&symbols);
+    VirtualMachine *vm = vm_new(&symbols);
+    bench_build(vm, &symbols, size);
+    // Verifying links the program too; neither is part of what is timed.
+    vm_verify(vm);
+    ASSERT(vm->state == VM_STATE_RUNNING, "benchmark program failed to %s",
+           "verify");
+    if (trace > 0)
+        vm_trace_start(vm, trace);
+
+    double best = 0;
+    for (usize r = 0; r < runs; r++) {
+        vm->ip = 0;
+        vm->state = VM_STATE_RUNNING;
+        vm->stack.size = 0;
+        vm->sp = 0;
+
+        double start = bench_now();
+        vm_execute(vm);
+        double seconds = bench_now() - start;
+        ASSERT(vm->state == VM_STATE_HALT, "benchmark program did not %s",
+               "halt");
+        if (r == 0 || seconds < best)
+            best = seconds;
+    }
+
+    usize instructions = vec_len(&vm->code);
+    printf("%-10s %12s %10s %10s\n", "dispatch", "instrs", "Minstr/s",
+           "ns/instr");
+    printf("%-10s %12zu %10.1f %10.2f\n", vm_dispatch_name(), instructions,
+           (double)instructions / best / 1e6,
+           best * 1e9 / (double)instructions);
+
+    vm_free(vm);
+    interner_free(&symbols);
+    return 0;
+}
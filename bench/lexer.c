@@ -0,0 +1,129 @@
+// Times the tokenizer over each file given, the way `main` drives it but
+// without printing, and reports throughput and allocations per token.
+//
+//   bench-lexer [--runs N] <file>...
+//
+// Each file is lexed N times (default 5) and the fastest run is reported.
+// Allocations are counted by wrapping malloc, calloc and realloc at link
+// time (-Wl,--wrap=...), so only calls made by the compiler itself count.
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common.h"
+#include "file.h"
+#include "intern.h"
+#include "literal.h"
+#include "tokenizer.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static usize allocations;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    allocations++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    allocations++;
+    return __real_realloc(ptr, size);
+}
+
+static double bench_now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+typedef struct {
+    double seconds;
+    usize tokens;
+    usize allocations;
+} BenchRun;
+
+static BenchRun bench_lex(File *file) {
+    Interner symbols;
+    LiteralPool literals;
+    interner_init(&symbols);
+    literal_pool_init(&literals);
+
+    BenchRun run = {0};
+    usize allocations_before = allocations;
+    double start = bench_now();
+
+    Tokenizer *tokenizer = tokenizer_new(file);
+    tokenizer->interner = &symbols;
+    tokenizer->literal_pool = &literals;
+    while (tokenizer_next_token(tokenizer).kind != TOKEN_EOF)
+        run.tokens++;
+
+    run.seconds = bench_now() - start;
+    run.allocations = allocations - allocations_before;
+
+    tokenizer_free(tokenizer);
+    literal_pool_free(&literals);
+    interner_free(&symbols);
+    return run;
+}
+
+int main(int argc, char **argv) {
+    usize runs = 5;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "--runs") == 0) {
+        runs = strtoul(argv[2], NULL, 10);
+        first = 3;
+    }
+    if (first >= argc || runs == 0) {
+        fprintf(stderr, "usage: %s [--runs N] <file>...\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-32s %10s %10s %10s %12s\n", "file", "MB", "MB/s", "Mtok/s",
+           "allocs/tok");
+    for (int i = first; i < argc; i++) {
+        File *file = file_new(SV(argv[i]));
+        file->id = 0;
+
+        BenchRun best = bench_lex(file);
+        for (usize r = 1; r < runs; r++) {
+            BenchRun run = bench_lex(file);
+            if (run.seconds < best.seconds)
+                best = run;
+        }
+
+        double mb = (double)vec_len(&file->contents) / 1e6;
+        usize tokens = best.tokens ? best.tokens : 1;
+        const char *name = strrchr(argv[i], '/');
+        name = name ? name + 1 : argv[i];
+        printf("%-32s %10.1f %10.1f %10.2f %12.4f\n", name, mb,
+               mb / best.seconds, (double)best.tokens / best.seconds / 1e6,
+               (double)best.allocations / (double)tokens);
+        file_free(file);
+    }
+    return 0;
+}
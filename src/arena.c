@@ -0,0 +1,52 @@
+#include <stdlib.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN 8
+
+struct ArenaBlock {
+    ArenaBlock *prev;
+    usize used, capacity;
+    char data[]; // the header is a multiple of ARENA_ALIGN
+};
+
+void arena_init(Arena *arena, MemTag tag) {
+    arena->head = NULL;
+    arena->tag = tag;
+}
+
+void arena_free(Arena *arena) {
+    ArenaBlock *block = arena->head;
+    while (block != NULL) {
+        ArenaBlock *prev = block->prev;
+        mem_free(arena->tag, block, sizeof(ArenaBlock) + block->capacity);
+        block = prev;
+    }
+    arena->head = NULL;
+}
+
+rawptr arena_alloc(Arena *arena, usize size) {
+    size = (size + ARENA_ALIGN - 1) & ~(usize)(ARENA_ALIGN - 1);
+
+    ArenaBlock *block = arena->head;
+    if (block == NULL || block->capacity - block->used < size) {
+        // Oversized requests get a block of their own.
+        usize capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = mem_alloc(arena->tag, sizeof(ArenaBlock) + capacity);
+        block->prev = arena->head;
+        block->used = 0;
+        block->capacity = capacity;
+        arena->head = block;
+    }
+
+    rawptr result = block->data + block->used;
+    block->used += size;
+    return result;
+}
+
+string arena_strdup(Arena *arena, string s) {
+    char *data = arena_alloc(arena, s.size + 1);
+    memcpy(data, s.data, s.size);
+    data[s.size] = '\0';
+    return SV_LEN(data, s.size);
+}
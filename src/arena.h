@@ -0,0 +1,28 @@
+#ifndef _CYCLONE_ARENA_H
+#define _CYCLONE_ARENA_H
+
+#include "common.h"
+#include "mem.h"
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct ArenaBlock ArenaBlock;
+
+// A bump allocator over a list of blocks. Allocations live until the whole
+// arena is freed. Each phase of the compiler keeps one for what it builds
+// (token errors, AST nodes, VM programs, generated code, diagnostics), so
+// ending a phase frees it in a handful of `free` calls instead of one per
+// object.
+struct Arena {
+    ArenaBlock *head;
+    MemTag tag;
+};
+
+// Blocks are charged to `tag`; see mem.h.
+void arena_init(Arena *arena, MemTag tag);
+void arena_free(Arena *arena);
+// Returns `size` bytes aligned to 8.
+rawptr arena_alloc(Arena *arena, usize size);
+string arena_strdup(Arena *arena, string s);
+
+#endif // _CYCLONE_ARENA_H
@@ -2,40 +2,41 @@
 #include <stdlib.h>
 
 #include "ast.h"
+#include "output.h"
 #include "utf8.h"
 
 Ast ast_new(void) {
     Ast ast;
-    vec_init(&ast.nodes);
+    vec_init_tag(&ast.nodes, MEM_AST);
+    arena_init(&ast.arena, MEM_AST);
     return ast;
 }
 
 void ast_free(Ast *ast) {
-    AstNode *node;
-    vec_foreach(&ast->nodes, node) { ast_node_free(node); }
     vec_free(&ast->nodes);
+    arena_free(&ast->arena);
 }
 
 void ast_add_node(Ast *ast, AstNode *node) { vec_push(&ast->nodes, node); }
 
-AstNode *ast_node_new(AstNodeType type, Location loc) {
-    AstNode *node = malloc(sizeof(*node));
+AstNode *ast_node_new(Ast *ast, AstNodeType type, Location loc) {
+    AstNode *node = arena_alloc(&ast->arena, sizeof(*node));
     node->type = type;
     node->loc = loc;
     return node;
 }
 
-void ast_node_free(AstNode *node) { UNIMPLEMENTED_MSG("%s", "ast_node_free"); }
-
 static void ast_node_print(AstNode *node, Ast *ast, usize indent) {
     for (usize i = 0; i < indent; i++) {
-        printf("  ");
+        output_sv(&output_stdout, SV("  "));
     }
 
-    printf("%s%s %s0x%p %s<%u:%u:%u>%s\n", color(COLOR_RED, ATTR_NONE),
-           ast_node_type_to_string(node->type), color(COLOR_YELLOW, ATTR_NONE),
-           (rawptr)node, color(COLOR_MAGENTA, ATTR_NONE), node->loc.file_id,
-           node->loc.line, node->loc.column, color_reset());
+    output_printf(&output_stdout, "%s%s %s0x%p %s<%u:%u>%s\n",
+                  color(COLOR_RED, ATTR_NONE),
+                  ast_node_type_to_string(node->type),
+                  color(COLOR_YELLOW, ATTR_NONE), (rawptr)node,
+                  color(COLOR_MAGENTA, ATTR_NONE), node->loc.file_id,
+                  node->loc.offset, color_reset());
 
     switch (node->type) {
     case AST_BINARY_EXPR: {
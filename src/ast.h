@@ -1,6 +1,7 @@
 #ifndef _CYCLONE_AST_H
 #define _CYCLONE_AST_H
 
+#include "arena.h"
 #include "common.h"
 #include "location.h"
 #include "token.h"
@@ -36,16 +37,17 @@ struct AstNode {
     } data;
 };
 
+// Nodes are allocated in `arena` and freed all at once with the tree.
 typedef struct {
     vec(AstNode *) nodes;
+    Arena arena;
 } Ast;
 
 Ast ast_new(void);
 void ast_free(Ast *ast);
 void ast_add_node(Ast *ast, AstNode *node);
 
-AstNode *ast_node_new(AstNodeType type, Location loc);
-void ast_node_free(AstNode *node);
+AstNode *ast_node_new(Ast *ast, AstNodeType type, Location loc);
 
 void ast_print(Ast *ast, usize indent);
 
@@ -0,0 +1,33 @@
+#include <stdio.h>
+
+#include "arena.h"
+#include "common.h"
+
+string sv_from_fmt(Arena *arena, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    va_list args2;
+    va_copy(args2, args);
+    int size = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    char *data = arena_alloc(arena, size + 1);
+    vsnprintf(data, size + 1, fmt, args2);
+    va_end(args2);
+    return (string){data, size};
+}
+
+string sv_concat(Arena *arena, string a, string b) {
+    string result;
+    result.size = a.size + b.size;
+    result.data = arena_alloc(arena, result.size + 1);
+    memcpy(result.data, a.data, a.size);
+    memcpy(result.data + a.size, b.data, b.size);
+    result.data[result.size] = '\0';
+    return result;
+}
+
+char *u32_to_hex(Arena *arena, u32 value) {
+    char *result = arena_alloc(arena, 11);
+    sprintf(result, "0x%08x", value);
+    return result;
+}
@@ -1,8 +1,6 @@
 #ifndef _CYCLONE_COMMON_H
 #define _CYCLONE_COMMON_H
 
-#define VM_DEBUG
-
 #define ASSERT(cond, msg, ...)                                                 \
     do {                                                                       \
         if (!(cond)) {                                                         \
@@ -48,18 +46,11 @@ struct string {
 #define SV_FMT "%.*s"
 #define SV_ARG(s) (int)(s).size, (s).data
 
-static inline string sv_from_fmt(const char *fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-    va_list args2;
-    va_copy(args2, args);
-    int size = vsnprintf(NULL, 0, fmt, args);
-    va_end(args);
-    char *data = malloc(size + 1);
-    vsnprintf(data, size + 1, fmt, args2);
-    va_end(args2);
-    return (string){data, size};
-}
+// Defined in arena.h. The helpers below that build new strings allocate
+// them in the arena they are given, so they go away with it.
+typedef struct Arena Arena;
+
+string sv_from_fmt(Arena *arena, const char *fmt, ...);
 
 static inline bool sv_eq(string a, string b) {
     return a.size == b.size && memcmp(a.data, b.data, a.size) == 0;
@@ -74,21 +65,8 @@ static inline string sv_substr(string s, usize start, usize end) {
     return (string){s.data + start, end - start};
 }
 
-static inline string sv_concat(string a, string b) {
-    string result;
-    result.size = a.size + b.size;
-    result.data = malloc(result.size + 1);
-    memcpy(result.data, a.data, a.size);
-    memcpy(result.data + a.size, b.data, b.size);
-    result.data[result.size] = '\0';
-    return result;
-}
-
-static inline char *u32_to_hex(u32 value) {
-    char *result = malloc(9);
-    sprintf(result, "0x%08x", value);
-    return result;
-}
+string sv_concat(Arena *arena, string a, string b);
+char *u32_to_hex(Arena *arena, u32 value);
 
 typedef u8 Color;
 enum {
@@ -113,16 +91,9 @@ enum {
     ATTR_HIDDEN = 8,
 };
 
-static inline char *color(Color color, Attribute attr) {
-    char *result = malloc(10);
-    sprintf(result, "\033[%u;%um", attr, color);
-    return result;
-}
-
-static inline char *color_reset(void) {
-    char *result = malloc(10);
-    sprintf(result, "\033[0m");
-    return result;
-}
+// Cached escape sequences, or empty strings when color is off; see
+// output.h.
+const char *color(Color color, Attribute attr);
+const char *color_reset(void);
 
 #endif // _CYCLONE_COMMON_H
\ No newline at end of file
@@ -6,9 +6,13 @@
 Compiler *compiler_new(CompilationTarget target) {
     Compiler *compiler = malloc(sizeof(*compiler));
     compiler->target = target;
-    vec_init(&compiler->file_ids);
-    vec_init(&compiler->files);
-    vec_init(&compiler->file_names);
+    vec_init_tag(&compiler->file_ids, MEM_FILE);
+    vec_init_tag(&compiler->files, MEM_FILE);
+    vec_init_tag(&compiler->file_names, MEM_FILE);
+    map_init(&compiler->file_paths, MAP_KEY_STRING, MEM_FILE);
+    compiler->files_lock = mutex_new();
+    interner_init(&compiler->symbols);
+    literal_pool_init(&compiler->literals);
     compiler->ip = 0;
     return compiler;
 }
@@ -17,108 +21,128 @@ void compiler_free(Compiler *compiler) {
     vec_free(&compiler->file_ids);
     vec_free(&compiler->files);
     vec_free(&compiler->file_names);
+    map_free(&compiler->file_paths);
+    mutex_free(compiler->files_lock);
+    interner_free(&compiler->symbols);
+    literal_pool_free(&compiler->literals);
     free(compiler);
 }
 
 u32 compiler_new_file(Compiler *compiler, File *file) {
+    mutex_lock(compiler->files_lock);
     u32 id = compiler->files.size;
     vec_push(&compiler->file_ids, id);
     vec_push(&compiler->files, file);
     vec_push(&compiler->file_names, file->path);
+    map_put_str(&compiler->file_paths, file->path, id);
+    mutex_unlock(compiler->files_lock);
     return id;
 }
 
-static string compiler_value_to_string(Value value) {
+u32 compiler_find_file(Compiler *compiler, string path) {
+    mutex_lock(compiler->files_lock);
+    u64 id;
+    bool found = map_get_str(&compiler->file_paths, path, &id);
+    mutex_unlock(compiler->files_lock);
+    return found ? (u32)id : FILE_ID_NONE;
+}
+
+static string compiler_register_name(Register reg) {
+    switch (reg) {
+    case REG_RAX:
+        return SV("rax");
+    case REG_RBX:
+        return SV("rbx");
+    case REG_RCX:
+        return SV("rcx");
+    case REG_RDX:
+        return SV("rdx");
+    case REG_RSI:
+        return SV("rsi");
+    case REG_RDI:
+        return SV("rdi");
+    case REG_RBP:
+        return SV("rbp");
+    case REG_RSP:
+        return SV("rsp");
+    case REG_R8:
+        return SV("r8");
+    case REG_R9:
+        return SV("r9");
+    case REG_R10:
+        return SV("r10");
+    case REG_R11:
+        return SV("r11");
+    case REG_R12:
+        return SV("r12");
+    case REG_R13:
+        return SV("r13");
+    case REG_R14:
+        return SV("r14");
+    case REG_R15:
+        return SV("r15");
+    }
+    return SV("<unknown>");
+}
+
+static void compiler_emit_value(Compiler *compiler, VirtualMachine *vm,
+                                Emitter *emitter, Value value) {
     switch (value.type) {
-    case VALUE_NONE:
-        return SV("none");
+    case VALUE_NONE: {
+        emit_sv(emitter, SV("none"));
+    } break;
     case VALUE_REGISTER: {
-        switch (value.data.reg) {
-        case REG_RAX:
-            return SV("rax");
-        case REG_RBX:
-            return SV("rbx");
-        case REG_RCX:
-            return SV("rcx");
-        case REG_RDX:
-            return SV("rdx");
-        case REG_RSI:
-            return SV("rsi");
-        case REG_RDI:
-            return SV("rdi");
-        case REG_RBP:
-            return SV("rbp");
-        case REG_RSP:
-            return SV("rsp");
-        case REG_R8:
-            return SV("r8");
-        case REG_R9:
-            return SV("r9");
-        case REG_R10:
-            return SV("r10");
-        case REG_R11:
-            return SV("r11");
-        case REG_R12:
-            return SV("r12");
-        case REG_R13:
-            return SV("r13");
-        case REG_R14:
-            return SV("r14");
-        case REG_R15:
-            return SV("r15");
-        }
+        emit_sv(emitter, compiler_register_name(value.data.reg));
     } break;
     case VALUE_IMMEDIATE: {
-        return sv_from_fmt("0x%x", value.data.imm);
+        emit(emitter, "0x%llx",
+             (unsigned long long)(long long)value.data.imm);
+    } break;
+    case VALUE_LABEL: {
+        emit_sv(emitter, interner_get(&compiler->symbols, value.data.label));
+    } break;
+    case VALUE_ADDRESS: {
+        // Linked programs still have their labels at every address taken.
+        Label *label = vm_find_label_by_ip(vm, value.data.address);
+        ASSERT(label != NULL, "no label at address %zu", value.data.address);
+        emit_sv(emitter, interner_get(&compiler->symbols, label->name));
     } break;
-    case VALUE_LABEL:
-        return value.data.label;
     }
-    return SV("<unknown>");
 }
 
-string compiler_compile_x86_64(Compiler *compiler, VirtualMachine *vm) {
-    string result = SV("");
-    for (;;) {
+void compiler_compile_x86_64(Compiler *compiler, VirtualMachine *vm,
+                             Emitter *emitter) {
+    while (compiler->ip < vec_len(&vm->code)) {
         Label *label = vm_find_label_by_ip(vm, compiler->ip);
         if (label != NULL) {
-            string label_str = sv_from_fmt(SV_FMT ":\n", SV_ARG(label->name));
-            result = sv_concat(result, label_str);
+            string name = interner_get(&compiler->symbols, label->name);
+            emit(emitter, SV_FMT ":\n", SV_ARG(name));
         }
 
-        Instruction *instr = *vec_get(&vm->instructions, compiler->ip);
-        switch (instr->opcode) {
+        Instruction instr = vm_instruction(vm, compiler->ip);
+        switch (instr.opcode) {
         case OP_NOP: {
             compiler->ip++;
         } break;
         case OP_MOV: {
-            Value operand1 = instr->operand1;
-            Value operand2 = instr->operand2;
-            string operand1_str = compiler_value_to_string(operand1);
-            string operand2_str = compiler_value_to_string(operand2);
-            string instr_str = SV("    mov ");
-            instr_str = sv_concat(instr_str, operand1_str);
-            instr_str = sv_concat(instr_str, SV(", "));
-            instr_str = sv_concat(instr_str, operand2_str);
-            instr_str = sv_concat(instr_str, SV("\n"));
-            result = sv_concat(result, instr_str);
+            emit_sv(emitter, SV("    mov "));
+            compiler_emit_value(compiler, vm, emitter, instr.operand1);
+            emit_sv(emitter, SV(", "));
+            compiler_emit_value(compiler, vm, emitter, instr.operand2);
+            emit_sv(emitter, SV("\n"));
             compiler->ip++;
         } break;
         case OP_JMP: {
-            Value operand1 = instr->operand1;
-            string operand1_str = compiler_value_to_string(operand1);
-            string instr_str = SV("    jmp ");
-            instr_str = sv_concat(instr_str, operand1_str);
-            instr_str = sv_concat(instr_str, SV("\n"));
-            result = sv_concat(result, instr_str);
+            emit_sv(emitter, SV("    jmp "));
+            compiler_emit_value(compiler, vm, emitter, instr.operand1);
+            emit_sv(emitter, SV("\n"));
             compiler->ip++;
         } break;
         case OP_HLT: {
             compiler->ip++;
-            result = sv_concat(result, SV("    hlt\n"));
-            return result;
+            emit_sv(emitter, SV("    hlt\n"));
+            return;
         } break;
         }
     }
-    return result;
-}
\ No newline at end of file
+}
@@ -2,7 +2,12 @@
 #define _CYCLONE_COMPILER_H
 
 #include "common.h"
+#include "emitter.h"
 #include "file.h"
+#include "intern.h"
+#include "literal.h"
+#include "map.h"
+#include "thread.h"
 #include "vector.h"
 #include "vm.h"
 
@@ -11,18 +16,34 @@ enum {
     TARGET_WIN_X86_64,
 };
 
+#define FILE_ID_NONE ((u32)-1)
+
 typedef struct Compiler {
     CompilationTarget target;
     vec(u32) file_ids;
     vec(File *) files;
     vec(string) file_names;
+    // File id by path.
+    Map file_paths;
+    // Guards the file tables while files are added from several threads.
+    Mutex *files_lock;
+    // Identifiers and labels from every file, shared by all phases.
+    Interner symbols;
+    // Literal values from every file, decoded once by the tokenizer.
+    LiteralPool literals;
     usize ip;
 } Compiler;
 
 Compiler *compiler_new(CompilationTarget target);
 void compiler_free(Compiler *compiler);
+// May be called from several threads at once; ids are handed out in the
+// order the calls get the lock.
 u32 compiler_new_file(Compiler *compiler, File *file);
+// Id of the file added with `path`, or FILE_ID_NONE.
+u32 compiler_find_file(Compiler *compiler, string path);
 
-string compiler_compile_x86_64(Compiler *compiler, VirtualMachine *vm);
+// Writes the program's assembly to `emitter`.
+void compiler_compile_x86_64(Compiler *compiler, VirtualMachine *vm,
+                             Emitter *emitter);
 
 #endif // _CYCLONE_COMPILER_H
\ No newline at end of file
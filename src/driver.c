@@ -0,0 +1,80 @@
+#include <stdlib.h>
+
+#include "driver.h"
+#include "utf8.h"
+
+void driver_init(Driver *driver, Compiler *compiler, usize threads) {
+    driver->compiler = compiler;
+    driver->threads = threads;
+    driver->units = NULL;
+    driver->unit_count = 0;
+    driver->pool = NULL;
+}
+
+void driver_free(Driver *driver) {
+    for (usize i = 0; i < driver->unit_count; i++) {
+        CompilationUnit *unit = &driver->units[i];
+        token_buffer_free(&unit->tokens);
+        file_free(unit->file);
+    }
+    free(driver->units);
+    driver->units = NULL;
+    driver->unit_count = 0;
+}
+
+static void driver_run_stage(rawptr arg) {
+    CompilationUnit *unit = arg;
+    Driver *driver = unit->driver;
+
+    switch (unit->stage) {
+    case UNIT_LOAD: {
+        unit->file = file_new(unit->path);
+        unit->file->id = compiler_new_file(driver->compiler, unit->file);
+    } break;
+    case UNIT_TOKENIZE: {
+        interner_init(&unit->symbols);
+        literal_pool_init(&unit->literals);
+        unit->tokens =
+            tokenizer_tokenize(unit->file, &unit->symbols, &unit->literals);
+    } break;
+    case UNIT_DONE: {
+        return;
+    } break;
+    }
+
+    unit->stage++;
+    if (unit->stage != UNIT_DONE)
+        pool_submit(driver->pool, driver_run_stage, unit);
+}
+
+void driver_run(Driver *driver, string *paths, usize count) {
+    ASSERT(driver->units == NULL, "driver has already run (%zu files)",
+           driver->unit_count);
+
+    driver->units = malloc(count * sizeof(CompilationUnit));
+    driver->unit_count = count;
+
+    // The workers share these tables, so build them up front.
+    utf8_init();
+    tokenizer_init();
+
+    driver->pool = pool_new(driver->threads);
+    for (usize i = 0; i < count; i++) {
+        CompilationUnit *unit = &driver->units[i];
+        unit->driver = driver;
+        unit->path = paths[i];
+        unit->stage = UNIT_LOAD;
+        pool_submit(driver->pool, driver_run_stage, unit);
+    }
+    pool_free(driver->pool);
+    driver->pool = NULL;
+
+    Compiler *compiler = driver->compiler;
+    for (usize i = 0; i < count; i++) {
+        CompilationUnit *unit = &driver->units[i];
+        token_buffer_rebase(&unit->tokens, &compiler->symbols,
+                            &compiler->literals);
+        interner_free(&unit->symbols);
+        literal_pool_free(&unit->literals);
+    }
+}
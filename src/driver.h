@@ -0,0 +1,53 @@
+#ifndef _CYCLONE_DRIVER_H
+#define _CYCLONE_DRIVER_H
+
+#include "common.h"
+#include "compiler.h"
+#include "file.h"
+#include "intern.h"
+#include "literal.h"
+#include "pool.h"
+#include "tokenizer.h"
+
+// The phases an input file goes through, in order. Each phase runs as its
+// own task, queued by the phase before it, so different files can be in
+// different phases at once.
+typedef u8 UnitStage;
+enum {
+    UNIT_LOAD,
+    UNIT_TOKENIZE,
+    UNIT_DONE,
+};
+
+typedef struct Driver Driver;
+
+// An input file and what its phases produced. While the pool runs, its
+// tokens refer to `symbols` and `literals`, which only this unit touches;
+// `driver_run` moves them into the compiler's tables afterwards.
+typedef struct {
+    Driver *driver;
+    string path;
+    UnitStage stage;
+    File *file;
+    TokenBuffer tokens;
+    Interner symbols;
+    LiteralPool literals;
+} CompilationUnit;
+
+struct Driver {
+    Compiler *compiler;
+    usize threads;
+    CompilationUnit *units;
+    usize unit_count;
+    Pool *pool;
+};
+
+void driver_init(Driver *driver, Compiler *compiler, usize threads);
+void driver_free(Driver *driver);
+// Runs every file in `paths` through the pipeline on the driver's threads.
+// Files are merged into the compiler in the order given, once all of them
+// are done, so symbol and literal ids, and with them any output, come out
+// the same however the work was scheduled. `units[i]` is `paths[i]`.
+void driver_run(Driver *driver, string *paths, usize count);
+
+#endif // _CYCLONE_DRIVER_H
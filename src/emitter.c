@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "emitter.h"
+
+void emitter_init(Emitter *emitter, FILE *sink) {
+    vec_init_tag(&emitter->buffer, MEM_CODEGEN);
+    vec_reserve(&emitter->buffer, EMITTER_BUFFER_SIZE);
+    emitter->sink = sink;
+}
+
+void emitter_free(Emitter *emitter) {
+    emitter_flush(emitter);
+    vec_free(&emitter->buffer);
+}
+
+void emitter_flush(Emitter *emitter) {
+    if (emitter->sink == NULL || emitter->buffer.size == 0)
+        return;
+    usize written =
+        fwrite(emitter->buffer.data, 1, emitter->buffer.size, emitter->sink);
+    ASSERT(written == emitter->buffer.size, "could not write %zu bytes",
+           emitter->buffer.size);
+    emitter->buffer.size = 0;
+}
+
+string emitter_string(Emitter *emitter) {
+    return SV_LEN(emitter->buffer.data, emitter->buffer.size);
+}
+
+// Makes room for `size` more bytes, flushing first when there is a sink.
+static void emitter_reserve(Emitter *emitter, usize size) {
+    if (emitter->buffer.capacity - emitter->buffer.size >= size)
+        return;
+    emitter_flush(emitter);
+    vec_reserve(&emitter->buffer, size);
+}
+
+// Flushes once a sink's buffer is full, keeping it at a constant size.
+static void emitter_maybe_flush(Emitter *emitter) {
+    if (emitter->buffer.size >= EMITTER_BUFFER_SIZE)
+        emitter_flush(emitter);
+}
+
+void emit(Emitter *emitter, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    va_list args2;
+    va_copy(args2, args);
+    usize room = emitter->buffer.capacity - emitter->buffer.size;
+    int size = vsnprintf(emitter->buffer.data + emitter->buffer.size, room,
+                         fmt, args);
+    va_end(args);
+    // Only formatted twice when it did not fit.
+    if ((usize)size >= room) {
+        emitter_reserve(emitter, size + 1);
+        vsnprintf(emitter->buffer.data + emitter->buffer.size, size + 1, fmt,
+                  args2);
+    }
+    va_end(args2);
+    emitter->buffer.size += size;
+    emitter_maybe_flush(emitter);
+}
+
+void emit_sv(Emitter *emitter, string s) {
+    emitter_reserve(emitter, s.size);
+    memcpy(emitter->buffer.data + emitter->buffer.size, s.data, s.size);
+    emitter->buffer.size += s.size;
+    emitter_maybe_flush(emitter);
+}
@@ -0,0 +1,31 @@
+#ifndef _CYCLONE_EMITTER_H
+#define _CYCLONE_EMITTER_H
+
+#include <stdio.h>
+
+#include "common.h"
+#include "vector.h"
+
+#define EMITTER_BUFFER_SIZE (64 * 1024)
+
+// Appends generated text to `buffer`. With a sink, the buffer is written out
+// whenever it holds EMITTER_BUFFER_SIZE bytes, so memory stays constant
+// however much is emitted; without one it grows to hold all of it.
+typedef struct {
+    vec(char) buffer;
+    FILE *sink;
+} Emitter;
+
+// `sink` may be NULL to collect the output in memory.
+void emitter_init(Emitter *emitter, FILE *sink);
+// Flushes to the sink, if any, and releases the buffer.
+void emitter_free(Emitter *emitter);
+void emitter_flush(Emitter *emitter);
+// Everything emitted so far; only meaningful without a sink.
+string emitter_string(Emitter *emitter);
+
+// Formats straight into the buffer, without an intermediate string.
+void emit(Emitter *emitter, const char *fmt, ...);
+void emit_sv(Emitter *emitter, string s);
+
+#endif // _CYCLONE_EMITTER_H
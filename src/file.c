@@ -1,33 +1,300 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "file.h"
+#include "scan.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static bool file_map(File *file) {
+#ifdef _WIN32
+    HANDLE handle =
+        CreateFileA(file->path.data, GENERIC_READ, FILE_SHARE_READ, NULL,
+                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (GetFileType(handle) != FILE_TYPE_DISK ||
+        !GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+        CloseHandle(handle);
+        return false;
+    }
+
+    HANDLE mapping =
+        CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(handle);
+    if (mapping == NULL)
+        return false;
+
+    char *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (data == NULL)
+        return false;
+
+    usize len = (usize)size.QuadPart;
+#else
+    int fd = open(file->path.data, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    usize len = (usize)st.st_size;
+    char *data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    posix_madvise(data, len, POSIX_MADV_SEQUENTIAL);
+#endif
+
+    file->contents.data = data;
+    file->contents.size = len;
+    file->contents.capacity = len;
+    file->backing = FILE_BACKING_MMAP;
+    return true;
+}
+
+static void file_read(File *file, FILE *fp) {
+    for (;;) {
+        vec_reserve(&file->contents, FILE_READ_CHUNK);
+        usize n = fread(file->contents.data + file->contents.size, 1,
+                        FILE_READ_CHUNK, fp);
+        file->contents.size += n;
+        if (n < FILE_READ_CHUNK)
+            break;
+    }
+}
 
 File *file_new(string path) {
     File *file = malloc(sizeof(*file));
     file->path = path;
+    file->stream = NULL;
+    file->backing = FILE_BACKING_HEAP;
 
-    vec_init(&file->contents);
+    vec_init_tag(&file->contents, MEM_FILE);
+    vec_init_tag(&file->line_starts, MEM_FILE);
+    vec_init_tag(&file->continuations, MEM_FILE);
+    vec_init_tag(&file->line_continuations, MEM_FILE);
 
-    FILE *fp = fopen(path.data, "r");
-    if (!fp) {
-        fprintf(stderr, "error: could not open file '" SV_FMT "'\n",
-                SV_ARG(path));
-        exit(1);
+    if (sv_eq_cstr(path, "-")) {
+        file_read(file, stdin);
+    } else if (!file_map(file)) {
+        FILE *fp = fopen(path.data, "rb");
+        if (!fp) {
+            fprintf(stderr, "error: could not open file '" SV_FMT "'\n",
+                    SV_ARG(path));
+            exit(1);
+        }
+        file_read(file, fp);
+        fclose(fp);
     }
 
-    char c;
-    while ((c = fgetc(fp)) != EOF) {
-        vec_push(&file->contents, c);
-    }
+    file->id = -1;
+    file->utf8_state = UTF8_ACCEPT;
+    file_validate_utf8(file, file->contents.data, file->contents.size, 0,
+                       true);
+    return file;
+}
+
+File *file_open_stream(string path) {
+    File *file = malloc(sizeof(*file));
+    file->path = path;
+    file->backing = FILE_BACKING_STREAM;
 
-    fclose(fp);
+    vec_init_tag(&file->contents, MEM_FILE);
+    vec_init_tag(&file->line_starts, MEM_FILE);
+    vec_init_tag(&file->continuations, MEM_FILE);
+    vec_init_tag(&file->line_continuations, MEM_FILE);
+    vec_push(&file->line_starts, 0);
+    vec_push(&file->line_continuations, 0);
+
+    if (sv_eq_cstr(path, "-")) {
+        file->stream = stdin;
+    } else {
+        file->stream = fopen(path.data, "rb");
+        if (!file->stream) {
+            fprintf(stderr, "error: could not open file '" SV_FMT "'\n",
+                    SV_ARG(path));
+            exit(1);
+        }
+    }
 
     file->id = -1;
+    file->utf8_state = UTF8_ACCEPT;
     return file;
 }
 
+static void file_unmap(File *file) {
+#ifdef _WIN32
+    UnmapViewOfFile(file->contents.data);
+#else
+    munmap(file->contents.data, file->contents.size);
+#endif
+}
+
+void file_edit(File *file, TextEdit edit) {
+    ASSERT(file->backing != FILE_BACKING_STREAM,
+           "cannot edit streamed file '" SV_FMT "'", SV_ARG(file->path));
+    ASSERT(edit.offset + edit.deleted <= file->contents.size,
+           "edit past the end of file '" SV_FMT "'", SV_ARG(file->path));
+
+    if (file->backing == FILE_BACKING_MMAP) {
+        char *data = mem_alloc(file->contents.tag,
+                               file->contents.size + edit.inserted.size);
+        memcpy(data, file->contents.data, file->contents.size);
+        file_unmap(file);
+        file->contents.data = data;
+        file->contents.capacity = file->contents.size + edit.inserted.size;
+        file->backing = FILE_BACKING_HEAP;
+    }
+
+    vec_splice(&file->contents, edit.offset, edit.deleted, edit.inserted.data,
+               edit.inserted.size);
+    file->line_starts.size = 0;
+}
+
 void file_free(File *file) {
-    vec_free(&file->contents);
+    if (file->backing == FILE_BACKING_STREAM) {
+        if (file->stream != stdin)
+            fclose(file->stream);
+    } else if (file->backing == FILE_BACKING_MMAP) {
+        file_unmap(file);
+    } else {
+        vec_free(&file->contents);
+    }
+    vec_free(&file->line_starts);
+    vec_free(&file->continuations);
+    vec_free(&file->line_continuations);
     free(file);
-}
\ No newline at end of file
+}
+
+void file_validate_utf8(File *file, const char *data, usize len, usize base,
+                        bool last) {
+    usize bad = utf8_validate_partial(&file->utf8_state, data, len);
+    if (bad == len && (!last || file->utf8_state == UTF8_ACCEPT))
+        return;
+
+    // Cut off by the end of the input: point at the lead byte.
+    if (bad == len) {
+        while (bad > 0 && ((u8)data[bad - 1] & 0xC0) == 0x80)
+            bad--;
+        if (bad > 0)
+            bad--;
+    }
+
+    // A stream only keeps line starts up to the current chunk, so index this
+    // one before reporting where the error is.
+    u32 offset = (u32)(base + bad);
+    if (file->backing == FILE_BACKING_STREAM)
+        file_index_lines(file, data, bad, base);
+    fprintf(stderr, "error: file '" SV_FMT "' is not valid UTF-8 at %u:%u\n",
+            SV_ARG(file->path), file_line(file, offset),
+            file_column(file, offset));
+    exit(1);
+}
+
+// Records the continuation bytes in `data` and, for every line start from
+// `first_line` on, how many continuation bytes come before it.
+static void file_index_continuations(File *file, const char *data, usize len,
+                                     usize base, usize first_line) {
+    usize counted = file->continuations.size;
+    usize i = 0;
+    while (i < len) {
+        // Skip ASCII eight bytes at a time.
+        u64 word;
+        if (i + 8 <= len) {
+            memcpy(&word, data + i, 8);
+            if ((word & 0x8080808080808080ull) == 0) {
+                i += 8;
+                continue;
+            }
+        }
+        if (((u8)data[i] & 0xC0) == 0x80)
+            vec_push(&file->continuations, (u32)(base + i));
+        i++;
+    }
+
+    for (usize line = first_line; line < file->line_starts.size; line++) {
+        u32 start = *vec_get(&file->line_starts, line);
+        while (counted < file->continuations.size &&
+               *vec_get(&file->continuations, counted) < start)
+            counted++;
+        vec_push(&file->line_continuations, (u32)counted);
+    }
+}
+
+void file_index_lines(File *file, const char *data, usize len, usize base) {
+    scan_init();
+    usize first_line = file->line_starts.size;
+    for (usize i = 0; i < len; i += FILE_READ_CHUNK) {
+        usize n = len - i < FILE_READ_CHUNK ? len - i : FILE_READ_CHUNK;
+        vec_reserve(&file->line_starts, n);
+        file->line_starts.size += scan_kernels.line_starts(
+            data + i, n, (u32)(base + i),
+            file->line_starts.data + file->line_starts.size);
+    }
+    if (file->backing == FILE_BACKING_STREAM)
+        file_index_continuations(file, data, len, base, first_line);
+}
+
+// Index into `line_starts` of the line holding `offset`.
+static usize file_line_index(File *file, u32 offset) {
+    if (file->line_starts.size == 0) {
+        vec_push(&file->line_starts, 0);
+        file_index_lines(file, file->contents.data, file->contents.size, 0);
+    }
+
+    usize lo = 0, hi = file->line_starts.size;
+    while (hi - lo > 1) {
+        usize mid = lo + (hi - lo) / 2;
+        if (*vec_get(&file->line_starts, mid) <= offset)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+u32 file_line(File *file, u32 offset) {
+    return (u32)file_line_index(file, offset) + 1;
+}
+
+u32 file_column(File *file, u32 offset) {
+    usize line = file_line_index(file, offset);
+    u32 start = *vec_get(&file->line_starts, line);
+    usize continuations;
+    if (file->backing == FILE_BACKING_STREAM) {
+        // Continuation bytes before `offset`, less those before the line.
+        usize lo = *vec_get(&file->line_continuations, line);
+        usize hi = file->continuations.size;
+        while (lo < hi) {
+            usize mid = lo + (hi - lo) / 2;
+            if (*vec_get(&file->continuations, mid) < offset)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        continuations = lo - *vec_get(&file->line_continuations, line);
+    } else {
+        continuations = (offset - start) -
+                        utf8_count(file->contents.data + start, offset - start);
+    }
+    return offset - start - (u32)continuations + 1;
+}
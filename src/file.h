@@ -2,15 +2,72 @@
 #define _CYCLONE_FILE_H
 
 #include "common.h"
+#include "utf8.h"
 #include "vector.h"
 
+#define FILE_READ_CHUNK (64 * 1024)
+
+typedef u8 FileBacking;
+enum {
+    FILE_BACKING_HEAP, // contents were read into a malloc'd buffer
+    FILE_BACKING_MMAP, // contents are a read-only mapping of the file
+    FILE_BACKING_STREAM, // contents are empty; the tokenizer reads `stream`
+};
+
 typedef struct {
     string path;
+    // For mapped files `contents` aliases the mapping and must not be pushed
+    // to or freed directly; use `file_span` for read-only access.
     vec(char) contents;
+    FILE *stream;
+    FileBacking backing;
+    // Where validation stopped in the stream, between chunks.
+    Utf8State utf8_state;
     u32 id;
+
+    // Offset of the first byte of every line. Built on first use, except for
+    // streamed files, whose tokenizer fills it as chunks are read.
+    vec(u32) line_starts;
+    // Streamed files only, since their bytes are gone by the time a column
+    // is asked for: the offset of every UTF-8 continuation byte, and how
+    // many of them come before each line start.
+    vec(u32) continuations;
+    vec(u32) line_continuations;
 } File;
 
+// Replaces `deleted` bytes at `offset` with `inserted`.
+typedef struct {
+    usize offset;
+    usize deleted;
+    string inserted;
+} TextEdit;
+
+// Maps `path` into memory when it is a regular file, otherwise reads it once
+// (pipes, character devices, or "-" for stdin).
 File *file_new(string path);
+// Opens `path` (or stdin for "-") without loading it, so that a tokenizer can
+// pull it through a fixed-size window.
+File *file_open_stream(string path);
+// Applies `edit` to the contents. A mapped file is copied to the heap on its
+// first edit.
+void file_edit(File *file, TextEdit edit);
 void file_free(File *file);
 
-#endif // _CYCLONE_FILE_H
\ No newline at end of file
+// Checks that `data`, the file's bytes from offset `base`, is valid UTF-8
+// and exits with an error otherwise. Pieces must be passed in order, with
+// `last` set on the final one.
+void file_validate_utf8(File *file, const char *data, usize len, usize base,
+                        bool last);
+// Appends the start of every line that begins after a newline in `data`,
+// which holds the file's bytes from offset `base`. Streamed files also
+// record their continuation bytes, so columns can be counted later.
+void file_index_lines(File *file, const char *data, usize len, usize base);
+// 1-based line and column of `offset`. Columns count codepoints.
+u32 file_line(File *file, u32 offset);
+u32 file_column(File *file, u32 offset);
+
+static inline string file_span(File *file) {
+    return SV_LEN(file->contents.data, file->contents.size);
+}
+
+#endif // _CYCLONE_FILE_H
@@ -1,13 +1,47 @@
-#include <stdlib.h>
-
 #include "instrucation.h"
 
-Instruction *instruction_new(Opcode opcode, Value operand1, Value operand2) {
-    Instruction *instruction = malloc(sizeof(Instruction));
-    instruction->opcode = opcode;
-    instruction->operand1 = operand1;
-    instruction->operand2 = operand2;
+Instruction instruction_new(Opcode opcode, Value operand1, Value operand2) {
+    Instruction instruction;
+    instruction.opcode = opcode;
+    instruction.operand1 = operand1;
+    instruction.operand2 = operand2;
     return instruction;
 }
 
-void instruction_free(Instruction *instruction) { free(instruction); }
\ No newline at end of file
+Opcode opcode_generic(Opcode opcode) {
+    switch (opcode) {
+    case OP_MOV_RR:
+    case OP_MOV_RI:
+    case OP_MOV_RK:
+        return OP_MOV;
+    case OP_ADD_RR:
+    case OP_ADD_RI:
+    case OP_ADD_RK:
+        return OP_ADD;
+    case OP_SUB_RR:
+    case OP_SUB_RI:
+    case OP_SUB_RK:
+        return OP_SUB;
+    case OP_MUL_RR:
+    case OP_MUL_RI:
+    case OP_MUL_RK:
+        return OP_MUL;
+    case OP_DIV_RR:
+    case OP_DIV_RI:
+    case OP_DIV_RK:
+        return OP_DIV;
+    case OP_MOD_RR:
+    case OP_MOD_RI:
+    case OP_MOD_RK:
+        return OP_MOD;
+    case OP_PUSH_R:
+    case OP_PUSH_I:
+    case OP_PUSH_K:
+        return OP_PUSH;
+    case OP_POP_R:
+        return OP_POP;
+    case OP_JMP_A:
+        return OP_JMP;
+    }
+    return opcode;
+}
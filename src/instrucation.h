@@ -2,6 +2,7 @@
 #define _CYCLONE_INSTRUCTION_H
 
 #include "common.h"
+#include "intern.h"
 #include "vector.h"
 
 typedef u8 Opcode;
@@ -14,10 +15,25 @@ enum {
     OP_JMP, OP_JE, OP_JNE, OP_JG, OP_JGE, OP_JL, OP_JLE,
     OP_CMP,
     OP_CALL, OP_RET,
+
+    // Operand-specialized forms, which only `vm_verify` produces. `_RR`
+    // takes two registers, `_RI` a register and an inline immediate, `_RK`
+    // a register and a constant from the pool.
+    OP_MOV_RR = 0x40, OP_MOV_RI, OP_MOV_RK,
+    OP_ADD_RR, OP_ADD_RI, OP_ADD_RK, OP_SUB_RR, OP_SUB_RI, OP_SUB_RK,
+    OP_MUL_RR, OP_MUL_RI, OP_MUL_RK, OP_DIV_RR, OP_DIV_RI, OP_DIV_RK,
+    OP_MOD_RR, OP_MOD_RI, OP_MOD_RK,
+    OP_PUSH_R, OP_PUSH_I, OP_PUSH_K, OP_POP_R,
+    OP_JMP_A,
+
+    OP_END = 0xFE, // the sentinel after a running program; never emitted
     OP_HLT = 0xFF,
     // clang-format on
 };
 
+// The opcode a specialized form was made from, or `opcode` itself.
+Opcode opcode_generic(Opcode opcode);
+
 #define NOP() instruction_new(OP_NOP, NONE_VALUE, NONE_VALUE)
 #define MOV(a, b) instruction_new(OP_MOV, a, b)
 #define PUSH(a) instruction_new(OP_PUSH, a, NONE_VALUE)
@@ -52,11 +68,19 @@ enum {
 };
 
 typedef struct {
-    enum { VALUE_NONE, VALUE_REGISTER, VALUE_IMMEDIATE, VALUE_LABEL } type;
+    enum {
+        VALUE_NONE,
+        VALUE_REGISTER,
+        VALUE_IMMEDIATE,
+        VALUE_LABEL,
+        // An instruction index, which `vm_link` puts in place of a label.
+        VALUE_ADDRESS,
+    } type;
     union {
         Register reg;
         double imm;
-        string label;
+        Symbol label;
+        usize address;
     } data;
 } Value;
 
@@ -70,6 +94,8 @@ static inline char *value_to_string(Value value) {
         return "immediate";
     case VALUE_LABEL:
         return "label";
+    case VALUE_ADDRESS:
+        return "address";
     }
     return "unknown";
 }
@@ -77,18 +103,49 @@ static inline char *value_to_string(Value value) {
 #define NONE_VALUE ((Value){.type = VALUE_NONE})
 #define REG_VALUE(x) ((Value){.type = VALUE_REGISTER, .data.reg = x})
 #define IMM_VALUE(x) ((Value){.type = VALUE_IMMEDIATE, .data.imm = x})
-#define LABEL_VALUE(x) ((Value){.type = VALUE_LABEL, .data.label = SV(x)})
+#define LABEL_VALUE(x) ((Value){.type = VALUE_LABEL, .data.label = x})
+#define ADDRESS_VALUE(x) ((Value){.type = VALUE_ADDRESS, .data.address = x})
 
 #define AS_REGISTER(x) ((x).data.reg)
 #define AS_IMMEDIATE(x) ((x).data.imm)
 #define AS_LABEL(x) ((x).data.label)
+#define AS_ADDRESS(x) ((x).data.address)
 
 typedef struct {
     Opcode opcode;
     Value operand1, operand2;
 } Instruction;
 
-Instruction *instruction_new(Opcode opcode, Value operand1, Value operand2);
-void instruction_free(Instruction *instruction);
+// Instructions are built by value; `vm_emit` packs them into the VM's
+// program.
+Instruction instruction_new(Opcode opcode, Value operand1, Value operand2);
+
+// How a packed operand is stored. Registers live in a nibble of `regs`;
+// every other kind of operand is held in `arg`, so an instruction can have
+// at most one operand that is not a register.
+typedef u8 OperandMode;
+enum {
+    OPERAND_NONE,
+    OPERAND_REGISTER,
+    OPERAND_IMMEDIATE, // `arg` is the value, as an i32
+    OPERAND_CONSTANT,  // `arg` indexes the VM's constant pool
+    OPERAND_LABEL,     // `arg` is the label's symbol
+    OPERAND_ADDRESS,   // `arg` is an instruction index
+};
+
+// One instruction of a VM program, which is a contiguous array of these.
+// The low nibbles of `modes` and `regs` describe the first operand, the
+// high nibbles the second.
+typedef struct {
+    Opcode opcode;
+    u8 modes;
+    u8 regs;
+    u32 arg;
+} PackedInstruction;
+
+#define PACKED_MODE1(p) ((OperandMode)((p)->modes & 0xF))
+#define PACKED_MODE2(p) ((OperandMode)((p)->modes >> 4))
+#define PACKED_REG1(p) ((Register)((p)->regs & 0xF))
+#define PACKED_REG2(p) ((Register)((p)->regs >> 4))
 
 #endif // _CYCLONE_INSTRUCTION_H
\ No newline at end of file
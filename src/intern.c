@@ -0,0 +1,83 @@
+#include <stdlib.h>
+
+#include "intern.h"
+
+#define INTERN_INITIAL_CAPACITY 256
+
+// Mixes eight bytes at a time; identifiers rarely need more than two rounds.
+u32 intern_hash(const char *s, usize len) {
+    u64 h = 0x9e3779b97f4a7c15ull ^ len;
+    for (; len >= 8; s += 8, len -= 8) {
+        u64 word;
+        memcpy(&word, s, 8);
+        h = (h ^ word) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    u64 tail = 0;
+    memcpy(&tail, s, len);
+    h = (h ^ tail) * 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 29;
+    return (u32)h;
+}
+
+static void interner_alloc_slots(Interner *interner, usize capacity) {
+    interner->slots = mem_alloc(MEM_TOKENIZER, capacity * sizeof(InternSlot));
+    for (usize i = 0; i < capacity; i++)
+        interner->slots[i].symbol = SYMBOL_NONE;
+    interner->capacity = capacity;
+}
+
+void interner_init(Interner *interner) {
+    arena_init(&interner->arena, MEM_TOKENIZER);
+    vec_init_tag(&interner->strings, MEM_TOKENIZER);
+    interner_alloc_slots(interner, INTERN_INITIAL_CAPACITY);
+}
+
+void interner_free(Interner *interner) {
+    arena_free(&interner->arena);
+    vec_free(&interner->strings);
+    mem_free(MEM_TOKENIZER, interner->slots,
+             interner->capacity * sizeof(InternSlot));
+    interner->slots = NULL;
+    interner->capacity = 0;
+}
+
+static void interner_grow(Interner *interner) {
+    InternSlot *old = interner->slots;
+    usize old_capacity = interner->capacity;
+    interner_alloc_slots(interner, old_capacity * 2);
+
+    usize mask = interner->capacity - 1;
+    for (usize i = 0; i < old_capacity; i++) {
+        if (old[i].symbol == SYMBOL_NONE)
+            continue;
+        usize j = old[i].hash & mask;
+        while (interner->slots[j].symbol != SYMBOL_NONE)
+            j = (j + 1) & mask;
+        interner->slots[j] = old[i];
+    }
+    mem_free(MEM_TOKENIZER, old, old_capacity * sizeof(InternSlot));
+}
+
+Symbol intern(Interner *interner, string s) {
+    u32 hash = intern_hash(s.data, s.size);
+    usize mask = interner->capacity - 1;
+    usize i = hash & mask;
+    for (;; i = (i + 1) & mask) {
+        InternSlot *slot = &interner->slots[i];
+        if (slot->symbol == SYMBOL_NONE)
+            break;
+        if (slot->hash == hash &&
+            sv_eq(interner_get(interner, slot->symbol), s))
+            return slot->symbol;
+    }
+
+    Symbol symbol = (Symbol)vec_len(&interner->strings);
+    vec_push(&interner->strings, arena_strdup(&interner->arena, s));
+    interner->slots[i] = (InternSlot){hash, symbol};
+
+    // Keep the table at most half full so probe sequences stay short.
+    if (vec_len(&interner->strings) * 2 > interner->capacity)
+        interner_grow(interner);
+    return symbol;
+}
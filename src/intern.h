@@ -0,0 +1,43 @@
+#ifndef _CYCLONE_INTERN_H
+#define _CYCLONE_INTERN_H
+
+#include "arena.h"
+#include "common.h"
+#include "vector.h"
+
+// Interned strings are identified by dense ids handed out in insertion
+// order, so equal names compare as equal integers.
+typedef u32 Symbol;
+#define SYMBOL_NONE ((Symbol)-1)
+
+typedef struct {
+    u32 hash;
+    Symbol symbol;
+} InternSlot;
+
+// An open-addressing table with linear probing. The text of every symbol is
+// copied into `arena`, so it outlives the source it was read from.
+typedef struct {
+    Arena arena;
+    vec(string) strings;
+    InternSlot *slots;
+    usize capacity;
+} Interner;
+
+// The hash `intern` keys its table with, also used by other tables of
+// source text.
+u32 intern_hash(const char *s, usize len);
+
+void interner_init(Interner *interner);
+void interner_free(Interner *interner);
+Symbol intern(Interner *interner, string s);
+
+static inline string interner_get(Interner *interner, Symbol symbol) {
+    return *vec_get(&interner->strings, symbol);
+}
+
+static inline usize interner_len(Interner *interner) {
+    return vec_len(&interner->strings);
+}
+
+#endif // _CYCLONE_INTERN_H
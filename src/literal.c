@@ -0,0 +1,302 @@
+#include <stdlib.h>
+
+#include "intern.h"
+#include "literal.h"
+
+#define LITERAL_INITIAL_CAPACITY 64
+
+static void literal_pool_alloc_slots(LiteralPool *pool, usize capacity) {
+    pool->slots = mem_alloc(MEM_TOKENIZER, capacity * sizeof(LiteralSlot));
+    for (usize i = 0; i < capacity; i++)
+        pool->slots[i].id = LITERAL_NONE;
+    pool->capacity = capacity;
+}
+
+void literal_pool_init(LiteralPool *pool) {
+    arena_init(&pool->arena, MEM_TOKENIZER);
+    vec_init_tag(&pool->literals, MEM_TOKENIZER);
+    vec_init_tag(&pool->scratch, MEM_TOKENIZER);
+    literal_pool_alloc_slots(pool, LITERAL_INITIAL_CAPACITY);
+}
+
+void literal_pool_free(LiteralPool *pool) {
+    arena_free(&pool->arena);
+    vec_free(&pool->literals);
+    vec_free(&pool->scratch);
+    mem_free(MEM_TOKENIZER, pool->slots,
+             pool->capacity * sizeof(LiteralSlot));
+    pool->slots = NULL;
+    pool->capacity = 0;
+}
+
+// The bytes a literal is compared and hashed by.
+static string literal_key(Literal *literal) {
+    switch (literal->kind) {
+    case LITERAL_STRING:
+        return literal->as.s;
+    case LITERAL_CHAR:
+        return SV_LEN((char *)&literal->as.c, sizeof(rune));
+    default:
+        return SV_LEN((char *)&literal->as.i, sizeof(i64));
+    }
+}
+
+static void literal_pool_grow(LiteralPool *pool) {
+    LiteralSlot *old = pool->slots;
+    usize old_capacity = pool->capacity;
+    literal_pool_alloc_slots(pool, old_capacity * 2);
+
+    usize mask = pool->capacity - 1;
+    for (usize i = 0; i < old_capacity; i++) {
+        if (old[i].id == LITERAL_NONE)
+            continue;
+        usize j = old[i].hash & mask;
+        while (pool->slots[j].id != LITERAL_NONE)
+            j = (j + 1) & mask;
+        pool->slots[j] = old[i];
+    }
+    mem_free(MEM_TOKENIZER, old, old_capacity * sizeof(LiteralSlot));
+}
+
+LiteralId literal_pool_add(LiteralPool *pool, Literal literal) {
+    string key = literal_key(&literal);
+    u32 hash = intern_hash(key.data, key.size) ^ literal.kind;
+    usize mask = pool->capacity - 1;
+    usize i = hash & mask;
+    for (;; i = (i + 1) & mask) {
+        LiteralSlot *slot = &pool->slots[i];
+        if (slot->id == LITERAL_NONE)
+            break;
+        Literal *other = literal_pool_get(pool, slot->id);
+        if (slot->hash == hash && other->kind == literal.kind &&
+            sv_eq(literal_key(other), key))
+            return slot->id;
+    }
+
+    if (literal.kind == LITERAL_STRING)
+        literal.as.s = arena_strdup(&pool->arena, literal.as.s);
+    LiteralId id = (LiteralId)vec_len(&pool->literals);
+    vec_push(&pool->literals, literal);
+    pool->slots[i] = (LiteralSlot){hash, id};
+
+    if (vec_len(&pool->literals) * 2 > pool->capacity)
+        literal_pool_grow(pool);
+    return id;
+}
+
+LiteralId literal_pool_string(LiteralPool *pool, string body) {
+    Literal literal = {.kind = LITERAL_STRING};
+    literal.as.s = body;
+    if (memchr(body.data, '\\', body.size) != NULL) {
+        pool->scratch.size = 0;
+        for (usize i = 0; i < body.size; i++) {
+            char c = body.data[i];
+            if (c == '\\' && i + 1 < body.size) {
+                int escape = literal_escape(body.data[++i]);
+                c = escape < 0 ? body.data[i] : (char)escape;
+            }
+            vec_push(&pool->scratch, c);
+        }
+        literal.as.s = SV_LEN(pool->scratch.data, pool->scratch.size);
+    }
+    return literal_pool_add(pool, literal);
+}
+
+LiteralId literal_pool_char(LiteralPool *pool, string body) {
+    Literal literal = {.kind = LITERAL_CHAR};
+    if (body.size >= 2 && body.data[0] == '\\') {
+        int escape = literal_escape(body.data[1]);
+        literal.as.c = escape < 0 ? (rune)(u8)body.data[1] : (rune)escape;
+    } else {
+        usize size;
+        literal.as.c = utf8_decode(body.data, body.size, &size);
+    }
+    return literal_pool_add(pool, literal);
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define LITERAL_SWAR
+#endif
+
+#ifdef LITERAL_SWAR
+// Eight ASCII digits at once: each step combines neighbouring lanes into
+// numbers of twice the width, 2 then 4 then 8 digits.
+static inline u64 literal_parse_eight(const char *p) {
+    u64 v;
+    memcpy(&v, p, 8);
+    v = (v & 0x0F0F0F0F0F0F0F0Full) * 2561 >> 8;
+    v = (v & 0x00FF00FF00FF00FFull) * 6553601 >> 16;
+    return (v & 0x0000FFFF0000FFFFull) * 42949672960001ull >> 32 & 0xFFFFFFFF;
+}
+#endif
+
+bool literal_parse_int(string text, i64 *out) {
+    usize i = 0;
+    while (i + 1 < text.size && text.data[i] == '0')
+        i++;
+    // Nineteen digits always fit in a u64, so only the last step can
+    // overflow an i64.
+    if (text.size - i > 19)
+        return false;
+
+    u64 value = 0;
+#ifdef LITERAL_SWAR
+    for (; i + 8 <= text.size; i += 8)
+        value = value * 100000000 + literal_parse_eight(text.data + i);
+#endif
+    for (; i < text.size; i++)
+        value = value * 10 + (u64)(text.data[i] - '0');
+    if (value > INT64_MAX)
+        return false;
+    *out = (i64)value;
+    return true;
+}
+
+#define LITERAL_POW10_MIN (-348)
+#define LITERAL_POW10_MAX 347
+
+static const u64 literal_pow10[][2] = {
+#define POW10(hi, lo) {hi, lo},
+#include "pow10.def"
+#undef POW10
+};
+
+// High half of the 128-bit product, with the low half in `lo`.
+static inline u64 literal_mul64(u64 a, u64 b, u64 *lo) {
+#if defined(__GNUC__) && defined(__SIZEOF_INT128__)
+    __extension__ typedef unsigned __int128 u128;
+    u128 product = (u128)a * b;
+    *lo = (u64)product;
+    return (u64)(product >> 64);
+#else
+    u64 a_lo = (u32)a, a_hi = a >> 32, b_lo = (u32)b, b_hi = b >> 32;
+    u64 p0 = a_lo * b_lo, p1 = a_lo * b_hi, p2 = a_hi * b_lo;
+    u64 mid = (p0 >> 32) + (u32)p1 + (u32)p2;
+    *lo = (mid << 32) | (u32)p0;
+    return a_hi * b_hi + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+#endif
+}
+
+static inline int literal_clz64(u64 x) {
+#ifdef __GNUC__
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    for (; !(x & 0x8000000000000000ull); x <<= 1)
+        n++;
+    return n;
+#endif
+}
+
+// `man * 10^exp10` correctly rounded, after Eisel and Lemire's algorithm as
+// used by Go's strconv. Returns false in the rare cases where the 128-bit
+// approximation cannot decide the rounding, or the result is subnormal or
+// out of range.
+static bool literal_eisel_lemire(u64 man, int exp10, double *out) {
+    if (man == 0) {
+        *out = 0.0;
+        return true;
+    }
+    if (exp10 < LITERAL_POW10_MIN || exp10 > LITERAL_POW10_MAX)
+        return false;
+
+    int clz = literal_clz64(man);
+    man <<= clz;
+    // floor(log2(10) * exp10) + 64, plus the double exponent bias.
+    u64 exp2 = (u64)(((i64)217706 * exp10 >> 16) + 64 + 1023) - (u64)clz;
+
+    const u64 *pow10 = literal_pow10[exp10 - LITERAL_POW10_MIN];
+    u64 lo;
+    u64 hi = literal_mul64(man, pow10[0], &lo);
+    // Only when the bits below the mantissa are all ones can the truncated
+    // low half of the power change the result.
+    if ((hi & 0x1FF) == 0x1FF && lo + man < man) {
+        u64 y_lo;
+        u64 y_hi = literal_mul64(man, pow10[1], &y_lo);
+        u64 merged_hi = hi, merged_lo = lo + y_hi;
+        if (merged_lo < lo)
+            merged_hi++;
+        if ((merged_hi & 0x1FF) == 0x1FF && merged_lo + 1 == 0 &&
+            y_lo + man < man)
+            return false;
+        hi = merged_hi;
+        lo = merged_lo;
+    }
+
+    u64 msb = hi >> 63;
+    u64 mantissa = hi >> (msb + 9);
+    exp2 -= 1 ^ msb;
+
+    // Exactly halfway between two doubles: leave it to strtod.
+    if (lo == 0 && (hi & 0x1FF) == 0 && (mantissa & 3) == 1)
+        return false;
+
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >> 53 > 0) {
+        mantissa >>= 1;
+        exp2++;
+    }
+    if (exp2 - 1 >= 0x7FF - 1)
+        return false;
+
+    u64 bits = exp2 << 52 | (mantissa & ((1ull << 52) - 1));
+    memcpy(out, &bits, sizeof(bits));
+    return true;
+}
+
+double literal_parse_float(string text) {
+    // Keep the first 19 significant digits; the rest only decide rounding
+    // and are accounted for below.
+    u64 man = 0;
+    int exp10 = 0, digits = 0;
+    bool fraction = false, truncated = false;
+    for (usize i = 0; i < text.size; i++) {
+        char c = text.data[i];
+        if (c == '.') {
+            fraction = true;
+            continue;
+        }
+        u64 d = (u64)(c - '0');
+        if (man == 0 && d == 0) {
+            if (fraction)
+                exp10--;
+        } else if (digits < 19) {
+            man = man * 10 + d;
+            digits++;
+            if (fraction)
+                exp10--;
+        } else {
+            if (!fraction)
+                exp10++;
+            truncated |= d != 0;
+        }
+    }
+
+    // Small values are exact as doubles, and so is one correctly rounded
+    // multiplication or division of them.
+    static const double exact[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+    if (!truncated && man >> 53 == 0 && exp10 >= -22 && exp10 <= 22)
+        return exp10 < 0 ? (double)man / exact[-exp10]
+                         : (double)man * exact[exp10];
+
+    // A truncated mantissa lies between `man` and `man + 1`; if both round
+    // the same way, so does the full one.
+    double value, upper;
+    if (literal_eisel_lemire(man, exp10, &value) &&
+        (!truncated ||
+         (literal_eisel_lemire(man + 1, exp10, &upper) && value == upper)))
+        return value;
+
+    char small[64];
+    char *buffer = text.size < sizeof(small) ? small : malloc(text.size + 1);
+    memcpy(buffer, text.data, text.size);
+    buffer[text.size] = '\0';
+    value = strtod(buffer, NULL);
+    if (buffer != small)
+        free(buffer);
+    return value;
+}
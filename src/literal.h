@@ -0,0 +1,88 @@
+#ifndef _CYCLONE_LITERAL_H
+#define _CYCLONE_LITERAL_H
+
+#include "arena.h"
+#include "common.h"
+#include "utf8.h"
+#include "vector.h"
+
+// Literals are decoded once, by the lexer, and referred to by their index in
+// a LiteralPool from then on.
+typedef u32 LiteralId;
+#define LITERAL_NONE ((LiteralId)-1)
+
+typedef u8 LiteralKind;
+enum {
+    LITERAL_INT,
+    LITERAL_FLOAT,
+    LITERAL_STRING,
+    LITERAL_CHAR,
+};
+
+typedef struct {
+    LiteralKind kind;
+    union {
+        i64 i;
+        double f;
+        string s; // unescaped, NUL-terminated
+        rune c;
+    } as;
+} Literal;
+
+typedef struct {
+    u32 hash;
+    LiteralId id;
+} LiteralSlot;
+
+// Equal literals share one entry. Decoded strings are copied into `arena`,
+// so they outlive the source; `scratch` holds a string while it is being
+// unescaped.
+typedef struct {
+    Arena arena;
+    vec(Literal) literals;
+    LiteralSlot *slots;
+    usize capacity;
+    vec(char) scratch;
+} LiteralPool;
+
+void literal_pool_init(LiteralPool *pool);
+void literal_pool_free(LiteralPool *pool);
+LiteralId literal_pool_add(LiteralPool *pool, Literal literal);
+// `body` is the text between the quotes, with escapes the lexer accepted.
+LiteralId literal_pool_string(LiteralPool *pool, string body);
+LiteralId literal_pool_char(LiteralPool *pool, string body);
+
+static inline Literal *literal_pool_get(LiteralPool *pool, LiteralId id) {
+    return vec_get(&pool->literals, id);
+}
+
+static inline usize literal_pool_len(LiteralPool *pool) {
+    return vec_len(&pool->literals);
+}
+
+// The byte `\code` stands for, or -1 when there is no such escape.
+static inline int literal_escape(char code) {
+    switch (code) {
+    case 'n':
+        return '\n';
+    case 't':
+        return '\t';
+    case 'r':
+        return '\r';
+    case '\\':
+    case '\'':
+    case '"':
+        return code;
+    case '0':
+        return '\0';
+    default:
+        return -1;
+    }
+}
+
+// Parses `[0-9]+`, returning false when the value does not fit in an i64.
+bool literal_parse_int(string text, i64 *out);
+// Parses `[0-9]+.[0-9]+`, rounding to the nearest double.
+double literal_parse_float(string text);
+
+#endif // _CYCLONE_LITERAL_H
@@ -4,15 +4,19 @@
 #include "common.h"
 #include "vector.h"
 
+// A byte offset into a file. Lines and columns are only worked out when a
+// location is printed, from the file's line-start table (see file.h, which
+// users of LOC_ARG must include).
 typedef struct {
     u32 file_id;
-    u32 line;
-    u32 column;
+    u32 offset;
 } Location;
 
-#define LOC(file_id, line, column) ((Location){file_id, line, column})
+#define LOC(file_id, offset) ((Location){file_id, offset})
 #define LOC_FMT SV_FMT ":%u:%u"
 #define LOC_ARG(c, loc)                                                        \
-    SV_ARG(*vec_get(&c->file_names, (loc).file_id)), (loc).line, (loc).column
+    SV_ARG(*vec_get(&c->file_names, (loc).file_id)),                           \
+        file_line(*vec_get(&c->files, (loc).file_id), (loc).offset),           \
+        file_column(*vec_get(&c->files, (loc).file_id), (loc).offset)
 
 #endif // _CYCLONE_LOCATION_H
\ No newline at end of file
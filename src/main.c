@@ -1,11 +1,17 @@
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "ast.h"
 #include "common.h"
 #include "compiler.h"
+#include "driver.h"
+#include "emitter.h"
 #include "file.h"
 #include "instrucation.h"
 #include "location.h"
+#include "mem.h"
+#include "output.h"
+#include "thread.h"
 #include "token.h"
 #include "tokenizer.h"
 #include "vector.h"
@@ -23,9 +29,80 @@
         system(x);                                                             \
     } while (0)
 
+static void print_tokenizer_error(Compiler *compiler, TokenizerError *err) {
+    output_printf(&output_stderr, "%s" LOC_FMT " %serror: %s" SV_FMT ".%s\n",
+                  color(COLOR_WHITE, ATTR_BOLD), LOC_ARG(compiler, err->loc),
+                  color(COLOR_RED, ATTR_BOLD), color(COLOR_WHITE, ATTR_BOLD),
+                  SV_ARG(err->message), color_reset());
+}
+
+static void print_tokens(Compiler *compiler, File *file, TokenBuffer *tokens) {
+    for (usize i = 0; i < vec_len(&tokens->kinds); i++) {
+        TokenKind kind = *vec_get(&tokens->kinds, i);
+        if (kind == TOKEN_EOF || kind == TOKEN_UNKNOWN)
+            break;
+        Location loc = LOC(file->id, *vec_get(&tokens->starts, i));
+        output_printf(&output_stdout, "[" LOC_FMT "] " SV_FMT "\n",
+                      LOC_ARG(compiler, loc),
+                      SV_ARG(token_buffer_lexeme(tokens, file, i)));
+    }
+}
+
+// The statistics go through stdio, so everything before them is flushed
+// first.
+static void print_mem_stats(void) {
+    if (!mem_stats_enabled)
+        return;
+    output_flush(&output_stdout);
+    output_flush(&output_stderr);
+    mem_print_stats(stderr);
+}
+
+// Everything after lexing, however the input was tokenized. Returns the
+// exit status.
+static int run_backend(Compiler *compiler, bool compile, usize trace) {
+    VirtualMachine *vm = vm_new(&compiler->symbols);
+
+    if (compile) {
+        FILE *fp = fopen("out.asm", "w");
+        if (!fp) {
+            fprintf(stderr, "error: could not open file 'out.asm'\n");
+            vm_free(vm);
+            return 1;
+        }
+        Emitter emitter;
+        emitter_init(&emitter, fp);
+        compiler_compile_x86_64(compiler, vm, &emitter);
+        emitter_free(&emitter);
+        fclose(fp);
+
+        // The commands below print through stdio.
+        output_flush(&output_stdout);
+
+        CMD("nasm -f win64 out.asm -o out.obj");
+        CMD("ld out.obj -o out.exe");
+        CMD("out.exe");
+    } else {
+        // The last `trace` instructions are kept, and shown if the VM fails.
+        if (trace > 0)
+            vm_trace_start(vm, trace);
+        vm_execute(vm);
+        if (vm->state == VM_STATE_ERROR)
+            vm_trace_dump(vm, &output_stderr);
+        // vm_dump(vm);
+    }
+
+    vm_free(vm);
+    return 0;
+}
+
 int main(int argc, char **argv) {
     if (argc < 3) {
-        fprintf(stderr, "usage: %s <compile/interpret> <file>\n", argv[0]);
+        fprintf(stderr,
+                "usage: %s <compile/interpret> <file>... [--stream] "
+                "[--threads N] [--trace N] [--mem-stats] "
+                "[--color|--no-color]\n",
+                argv[0]);
         return 1;
     }
 
@@ -35,14 +112,96 @@ int main(int argc, char **argv) {
     } else if (sv_eq_cstr(SV(argv[1]), "interpret")) {
         compile = false;
     } else {
-        fprintf(stderr, "usage: %s <compile/interpret> <file>\n", argv[0]);
+        fprintf(stderr,
+                "usage: %s <compile/interpret> <file>... [--stream] "
+                "[--threads N] [--trace N] [--mem-stats] "
+                "[--color|--no-color]\n",
+                argv[0]);
         return 1;
     }
 
-    string filename = SV(argv[2]);
+    vec(string) filenames;
+    vec_init(&filenames);
+    vec_push(&filenames, SV(argv[2]));
+
+    bool stream = false;
+    usize threads = 0;
+    usize trace = 0;
+    OutputColor color_mode = OUTPUT_COLOR_AUTO;
+    for (int i = 3; i < argc; i++) {
+        if (sv_eq_cstr(SV(argv[i]), "--stream")) {
+            stream = true;
+        } else if (sv_eq_cstr(SV(argv[i]), "--threads") && i + 1 < argc) {
+            threads = strtoul(argv[++i], NULL, 10);
+            if (threads == 0)
+                threads = thread_hardware_concurrency();
+        } else if (sv_eq_cstr(SV(argv[i]), "--trace") && i + 1 < argc) {
+            trace = strtoul(argv[++i], NULL, 10);
+        } else if (sv_eq_cstr(SV(argv[i]), "--mem-stats")) {
+            mem_stats_enabled = true;
+        } else if (sv_eq_cstr(SV(argv[i]), "--color")) {
+            color_mode = OUTPUT_COLOR_ALWAYS;
+        } else if (sv_eq_cstr(SV(argv[i]), "--no-color")) {
+            color_mode = OUTPUT_COLOR_NEVER;
+        } else if (argv[i][0] != '-') {
+            vec_push(&filenames, SV(argv[i]));
+        } else {
+            fprintf(stderr, "error: unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+
+    output_init(color_mode);
+
+    if (vec_len(&filenames) > 1 && stream) {
+        fprintf(stderr, "error: --stream takes a single file\n");
+        return 1;
+    }
+
+    // There is one out.asm, and nothing yet links several files into it.
+    if (vec_len(&filenames) > 1 && compile) {
+        fprintf(stderr, "error: compile takes a single file\n");
+        return 1;
+    }
+
+    if (threads > 0 && stream) {
+        fprintf(stderr, "error: --threads cannot be used with --stream\n");
+        return 1;
+    }
 
     Compiler *compiler = compiler_new(TARGET_WIN_X86_64);
-    File *file = file_new(filename);
+
+    // Several files go through the driver, one pipeline per file, and are
+    // reported in the order they were given. They then make up a single
+    // program for the rest of the pipeline.
+    if (vec_len(&filenames) > 1) {
+        Driver driver;
+        driver_init(&driver, compiler,
+                    threads > 0 ? threads : thread_hardware_concurrency());
+        driver_run(&driver, filenames.data, vec_len(&filenames));
+
+        for (usize i = 0; i < driver.unit_count; i++) {
+            CompilationUnit *unit = &driver.units[i];
+            print_tokens(compiler, unit->file, &unit->tokens);
+        }
+        for (usize i = 0; i < driver.unit_count; i++) {
+            TokenBuffer *tokens = &driver.units[i].tokens;
+            for (usize j = 0; j < vec_len(&tokens->errors); j++)
+                print_tokenizer_error(compiler, vec_get(&tokens->errors, j));
+        }
+
+        int status = run_backend(compiler, compile, trace);
+
+        driver_free(&driver);
+        compiler_free(compiler);
+        vec_free(&filenames);
+        print_mem_stats();
+        return status;
+    }
+
+    string filename = *vec_get(&filenames, 0);
+    vec_free(&filenames);
+    File *file = stream ? file_open_stream(filename) : file_new(filename);
     file->id = compiler_new_file(compiler, file);
 
     // for (usize i = 0; i < vec_len(&file->contents); i++) {
@@ -51,44 +210,44 @@ int main(int argc, char **argv) {
     // }
     // printf("\n");
 
-    Tokenizer *tokenizer = tokenizer_new(file);
-    Token tok = tokenizer_next_token(tokenizer);
-    for (;;) {
-        if (tok.kind == TOKEN_EOF || tok.kind == TOKEN_UNKNOWN)
-            break;
-        printf("[" LOC_FMT "] " SV_FMT "\n", LOC_ARG(compiler, tok.loc),
-               SV_ARG(tok.lexeme));
-        tok = tokenizer_next_token(tokenizer);
-    }
-
-    for (usize i = 0; i < vec_len(&tokenizer->errors); i++) {
-        TokenizerError *err = vec_get(&tokenizer->errors, i);
-        fprintf(stderr, "%s" LOC_FMT " %serror: %s" SV_FMT ".%s\n",
-                color(COLOR_WHITE, ATTR_BOLD), LOC_ARG(compiler, err->loc),
-                color(COLOR_RED, ATTR_BOLD), color(COLOR_WHITE, ATTR_BOLD),
-                SV_ARG(err->message), color_reset());
-    }
+    // Only lexing runs on several threads; the rest goes on as usual.
+    Tokenizer *tokenizer = NULL;
+    if (threads > 0) {
+        TokenBuffer tokens =
+            tokenizer_tokenize_parallel(file, threads, &compiler->symbols,
+                                        &compiler->literals);
 
-    VirtualMachine *vm = vm_new();
+        print_tokens(compiler, file, &tokens);
 
-    if (compile) {
-        string out = compiler_compile_x86_64(compiler, vm);
+        for (usize i = 0; i < vec_len(&tokens.errors); i++) {
+            print_tokenizer_error(compiler, vec_get(&tokens.errors, i));
+        }
 
-        FILE *fp = fopen("out.asm", "w");
-        fprintf(fp, SV_FMT, SV_ARG(out));
-        fclose(fp);
-
-        CMD("nasm -f win64 out.asm -o out.obj");
-        CMD("ld out.obj -o out.exe");
-        CMD("out.exe");
+        token_buffer_free(&tokens);
     } else {
-        vm_execute(vm);
-        // vm_dump(vm);
+        tokenizer = tokenizer_new(file);
+        tokenizer->interner = &compiler->symbols;
+        tokenizer->literal_pool = &compiler->literals;
+        Token tok = tokenizer_next_token(tokenizer);
+        for (;;) {
+            if (tok.kind == TOKEN_EOF || tok.kind == TOKEN_UNKNOWN)
+                break;
+            output_printf(&output_stdout, "[" LOC_FMT "] " SV_FMT "\n",
+                          LOC_ARG(compiler, tok.loc), SV_ARG(tok.lexeme));
+            tok = tokenizer_next_token(tokenizer);
+        }
+
+        for (usize i = 0; i < vec_len(&tokenizer->errors); i++) {
+            print_tokenizer_error(compiler, vec_get(&tokenizer->errors, i));
+        }
     }
 
-    vm_free(vm);
-    tokenizer_free(tokenizer);
+    int status = run_backend(compiler, compile, trace);
+
+    if (tokenizer != NULL)
+        tokenizer_free(tokenizer);
     file_free(file);
     compiler_free(compiler);
-    return 0;
+    print_mem_stats();
+    return status;
 }
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include <stdlib.h>
+
+#include "intern.h"
+#include "map.h"
+
+void map_init(Map *map, MapKeyKind kind, MemTag tag) {
+    map->entries = NULL;
+    map->size = 0;
+    map->capacity = 0;
+    map->kind = kind;
+    map->tag = tag;
+}
+
+void map_free(Map *map) {
+    mem_free(map->tag, map->entries, map->capacity * sizeof(MapEntry));
+    map_init(map, map->kind, map->tag);
+}
+
+void map_clear(Map *map) {
+    if (map->entries != NULL)
+        memset(map->entries, 0, map->capacity * sizeof(MapEntry));
+    map->size = 0;
+}
+
+static u32 map_hash_u32(u32 x) {
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+static u32 map_hash(Map *map, MapKey key) {
+    if (map->kind == MAP_KEY_U32)
+        return map_hash_u32(key.u);
+    return intern_hash(key.s.data, key.s.size);
+}
+
+static bool map_key_eq(Map *map, MapKey a, MapKey b) {
+    if (map->kind == MAP_KEY_U32)
+        return a.u == b.u;
+    return sv_eq(a.s, b.s);
+}
+
+static MapEntry *map_find(Map *map, MapKey key, u32 hash) {
+    if (map->size == 0)
+        return NULL;
+
+    usize mask = map->capacity - 1;
+    usize i = hash & mask;
+    for (u32 probe = 1;; probe++, i = (i + 1) & mask) {
+        MapEntry *entry = &map->entries[i];
+        // Entries along a run are ordered by probe distance, so one closer
+        // to home than the key would be means the key is absent. Empty
+        // slots have a distance of 0 and stop the search too.
+        if (entry->probe < probe)
+            return NULL;
+        if (entry->hash == hash && map_key_eq(map, entry->key, key))
+            return entry;
+    }
+}
+
+// Places an entry known to be absent, given there is room for it.
+static void map_insert(Map *map, MapEntry entry) {
+    usize mask = map->capacity - 1;
+    usize i = entry.hash & mask;
+    for (entry.probe = 1;; entry.probe++, i = (i + 1) & mask) {
+        MapEntry *slot = &map->entries[i];
+        if (slot->probe == 0) {
+            *slot = entry;
+            map->size++;
+            return;
+        }
+        if (slot->probe < entry.probe) {
+            MapEntry displaced = *slot;
+            *slot = entry;
+            entry = displaced;
+        }
+    }
+}
+
+static void map_grow(Map *map) {
+    MapEntry *old = map->entries;
+    usize old_capacity = map->capacity;
+    map->capacity = old_capacity ? old_capacity * 2 : MAP_MIN_CAPACITY;
+    map->entries = mem_alloc(map->tag, map->capacity * sizeof(MapEntry));
+    memset(map->entries, 0, map->capacity * sizeof(MapEntry));
+    map->size = 0;
+    for (usize i = 0; i < old_capacity; i++)
+        if (old[i].probe != 0)
+            map_insert(map, old[i]);
+    mem_free(map->tag, old, old_capacity * sizeof(MapEntry));
+}
+
+static void map_put(Map *map, MapKey key, u64 value) {
+    u32 hash = map_hash(map, key);
+    MapEntry *entry = map_find(map, key, hash);
+    if (entry != NULL) {
+        entry->value = value;
+        return;
+    }
+    // Robin Hood probing copes well with tables up to 7/8 full.
+    if ((map->size + 1) * 8 > map->capacity * 7)
+        map_grow(map);
+    map_insert(map, (MapEntry){key, value, hash, 0});
+}
+
+// Removes by shifting the rest of the run back one slot instead of leaving
+// a tombstone, so probe lengths do not degrade over time.
+static bool map_remove(Map *map, MapKey key) {
+    MapEntry *entry = map_find(map, key, map_hash(map, key));
+    if (entry == NULL)
+        return false;
+
+    usize mask = map->capacity - 1;
+    usize i = (usize)(entry - map->entries);
+    for (;;) {
+        MapEntry *next = &map->entries[(i + 1) & mask];
+        if (next->probe <= 1)
+            break;
+        map->entries[i] = *next;
+        map->entries[i].probe--;
+        i = (i + 1) & mask;
+    }
+    map->entries[i].probe = 0;
+    map->size--;
+    return true;
+}
+
+static bool map_get(Map *map, MapKey key, u64 *value) {
+    MapEntry *entry = map_find(map, key, map_hash(map, key));
+    if (entry != NULL && value != NULL)
+        *value = entry->value;
+    return entry != NULL;
+}
+
+bool map_get_str(Map *map, string key, u64 *value) {
+    MapKey k = {.s = key};
+    return map_get(map, k, value);
+}
+
+bool map_get_u32(Map *map, u32 key, u64 *value) {
+    MapKey k = {.u = key};
+    return map_get(map, k, value);
+}
+
+void map_put_str(Map *map, string key, u64 value) {
+    MapKey k = {.s = key};
+    map_put(map, k, value);
+}
+
+void map_put_u32(Map *map, u32 key, u64 value) {
+    MapKey k = {.u = key};
+    map_put(map, k, value);
+}
+
+bool map_remove_str(Map *map, string key) {
+    MapKey k = {.s = key};
+    return map_remove(map, k);
+}
+
+bool map_remove_u32(Map *map, u32 key) {
+    MapKey k = {.u = key};
+    return map_remove(map, k);
+}
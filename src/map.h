@@ -0,0 +1,59 @@
+#ifndef _CYCLONE_MAP_H
+#define _CYCLONE_MAP_H
+
+#include "common.h"
+#include "mem.h"
+
+#define MAP_MIN_CAPACITY 8
+
+typedef u8 MapKeyKind;
+enum {
+    MAP_KEY_STRING,
+    MAP_KEY_U32,
+};
+
+typedef union {
+    string s;
+    u32 u;
+} MapKey;
+
+typedef struct {
+    MapKey key;
+    u64 value;
+    u32 hash;
+    // Distance from the entry's home slot plus one; 0 marks an empty slot.
+    u32 probe;
+} MapEntry;
+
+// An open-addressing hash table with Robin Hood probing: an entry further
+// from its home slot takes the place of one that is closer to its own, so
+// probe lengths stay short and a lookup can stop as soon as it passes where
+// its key would have been. Keys are either strings, which are not copied and
+// must outlive the map, or u32s. Values are u64s, wide enough for an index
+// or a pointer.
+typedef struct {
+    MapEntry *entries;
+    usize size, capacity;
+    MapKeyKind kind;
+    MemTag tag;
+} Map;
+
+// The entries are charged to `tag`; see mem.h.
+void map_init(Map *map, MapKeyKind kind, MemTag tag);
+void map_free(Map *map);
+void map_clear(Map *map);
+
+// The lookups return whether the key is present, storing its value in
+// `value` unless that is NULL.
+bool map_get_str(Map *map, string key, u64 *value);
+bool map_get_u32(Map *map, u32 key, u64 *value);
+// Inserts the key or replaces its value.
+void map_put_str(Map *map, string key, u64 value);
+void map_put_u32(Map *map, u32 key, u64 value);
+// Returns whether the key was present.
+bool map_remove_str(Map *map, string key);
+bool map_remove_u32(Map *map, u32 key);
+
+static inline usize map_len(Map *map) { return map->size; }
+
+#endif // _CYCLONE_MAP_H
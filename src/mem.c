@@ -0,0 +1,75 @@
+#include <stdio.h>
+
+#include "mem.h"
+
+bool mem_stats_enabled = false;
+
+typedef struct {
+    usize live, peak;
+    usize allocations, reallocations, frees;
+    // Bytes held by blocks before they were reallocated, which is what a
+    // realloc that cannot grow in place has to copy.
+    usize churn;
+} MemStats;
+
+static MemStats mem_stats[MEM_TAG_COUNT];
+static usize mem_total_live, mem_total_peak;
+
+// The parallel tokenizer allocates from several threads at once.
+#ifdef __GNUC__
+#define MEM_ADD(p, n) __atomic_add_fetch(p, n, __ATOMIC_RELAXED)
+#else
+#define MEM_ADD(p, n) (*(p) += (n))
+#endif
+
+static void mem_raise_peak(usize *peak, usize live) {
+#ifdef __GNUC__
+    usize current = __atomic_load_n(peak, __ATOMIC_RELAXED);
+    while (current < live &&
+           !__atomic_compare_exchange_n(peak, &current, live, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+#else
+    if (*peak < live)
+        *peak = live;
+#endif
+}
+
+void mem_record(MemTag tag, usize old_size, usize new_size) {
+    MemStats *stats = &mem_stats[tag];
+    if (old_size == 0) {
+        MEM_ADD(&stats->allocations, 1);
+    } else if (new_size == 0) {
+        MEM_ADD(&stats->frees, 1);
+    } else {
+        MEM_ADD(&stats->reallocations, 1);
+        MEM_ADD(&stats->churn, old_size);
+    }
+
+    // Unsigned wraparound makes adding the difference work for shrinking
+    // blocks too.
+    mem_raise_peak(&stats->peak, MEM_ADD(&stats->live, new_size - old_size));
+    mem_raise_peak(&mem_total_peak,
+                   MEM_ADD(&mem_total_live, new_size - old_size));
+}
+
+void mem_print_stats(FILE *fp) {
+    static const char *names[MEM_TAG_COUNT] = {
+#define MEM_TAG(id, name) #name,
+#include "mem_tags.def"
+#undef MEM_TAG
+    };
+
+    fprintf(fp, "%-12s %12s %12s %10s %10s %10s %12s\n", "tag", "live",
+            "peak", "allocs", "reallocs", "frees", "churn");
+    for (usize i = 0; i < MEM_TAG_COUNT; i++) {
+        MemStats *stats = &mem_stats[i];
+        if (stats->allocations == 0)
+            continue;
+        fprintf(fp, "%-12s %12zu %12zu %10zu %10zu %10zu %12zu\n", names[i],
+                stats->live, stats->peak, stats->allocations,
+                stats->reallocations, stats->frees, stats->churn);
+    }
+    fprintf(fp, "%-12s %12zu %12zu\n", "total", mem_total_live,
+            mem_total_peak);
+}
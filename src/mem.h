@@ -0,0 +1,45 @@
+#ifndef _CYCLONE_MEM_H
+#define _CYCLONE_MEM_H
+
+#include "common.h"
+
+// The subsystem an allocation is charged to. Containers remember the tag
+// they were initialized with, so memory is attributed to its owner however
+// late it is grown or freed.
+typedef u8 MemTag;
+enum {
+#define MEM_TAG(id, name) MEM_##id,
+#include "mem_tags.def"
+#undef MEM_TAG
+
+    MEM_TAG_COUNT,
+};
+
+// Turned on once at startup by `--mem-stats`. While it is off, accounting
+// costs one well-predicted branch per allocation.
+extern bool mem_stats_enabled;
+
+// Accounts a block going from `old_size` to `new_size` bytes, where 0 on
+// either side is an allocation or a free. Safe to call from any thread.
+void mem_record(MemTag tag, usize old_size, usize new_size);
+// Live and peak bytes, allocation counts and realloc churn per tag.
+void mem_print_stats(FILE *fp);
+
+static inline rawptr mem_realloc(MemTag tag, rawptr ptr, usize old_size,
+                                 usize new_size) {
+    if (mem_stats_enabled)
+        mem_record(tag, old_size, new_size);
+    return realloc(ptr, new_size);
+}
+
+static inline rawptr mem_alloc(MemTag tag, usize size) {
+    return mem_realloc(tag, NULL, 0, size);
+}
+
+static inline void mem_free(MemTag tag, rawptr ptr, usize size) {
+    if (mem_stats_enabled && ptr != NULL)
+        mem_record(tag, size, 0);
+    free(ptr);
+}
+
+#endif // _CYCLONE_MEM_H
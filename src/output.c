@@ -0,0 +1,156 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "output.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <errno.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+Output output_stdout = {1, 0, {0}};
+Output output_stderr = {2, 0, {0}};
+
+// Every sequence `color` can return, built once by `output_init`. They stay
+// empty strings while color is off.
+#define OUTPUT_ATTRIBUTES (ATTR_HIDDEN + 1)
+#define OUTPUT_COLORS (COLOR_WHITE - COLOR_BLACK + 1)
+static char output_colors[OUTPUT_ATTRIBUTES][OUTPUT_COLORS][12];
+static char output_reset[8];
+
+const char *color(Color color, Attribute attr) {
+    return output_colors[attr][color - COLOR_BLACK];
+}
+
+const char *color_reset(void) { return output_reset; }
+
+static void output_flush_all(void) {
+    output_flush(&output_stdout);
+    output_flush(&output_stderr);
+}
+
+void output_init(OutputColor mode) {
+    bool enabled = mode == OUTPUT_COLOR_ALWAYS;
+    if (mode == OUTPUT_COLOR_AUTO) {
+#ifdef _WIN32
+        enabled = _isatty(2) && getenv("NO_COLOR") == NULL;
+#else
+        enabled = isatty(2) && getenv("NO_COLOR") == NULL;
+#endif
+    }
+
+    if (enabled) {
+        for (int attr = 0; attr < OUTPUT_ATTRIBUTES; attr++)
+            for (int c = 0; c < OUTPUT_COLORS; c++)
+                sprintf(output_colors[attr][c], "\033[%d;%dm", attr,
+                        COLOR_BLACK + c);
+        strcpy(output_reset, "\033[0m");
+    }
+    atexit(output_flush_all);
+}
+
+// Writes every slice in order with as few system calls as possible,
+// picking up after partial writes.
+static void output_write_slices(int fd, string *slices, int count) {
+#ifdef _WIN32
+    for (int i = 0; i < count; i++) {
+        usize done = 0;
+        while (done < slices[i].size) {
+            int n = _write(fd, slices[i].data + done,
+                           (unsigned)(slices[i].size - done));
+            if (n <= 0)
+                return;
+            done += (usize)n;
+        }
+    }
+#else
+    struct iovec iov[2];
+    ASSERT(count <= 2, "too many slices: %d", count);
+    for (int i = 0; i < count; i++) {
+        iov[i].iov_base = slices[i].data;
+        iov[i].iov_len = slices[i].size;
+    }
+
+    struct iovec *next = iov;
+    while (count > 0) {
+        ssize_t n = writev(fd, next, count);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        while (count > 0 && (usize)n >= next->iov_len) {
+            n -= (ssize_t)next->iov_len;
+            next++;
+            count--;
+        }
+        if (count > 0) {
+            next->iov_base = (char *)next->iov_base + n;
+            next->iov_len -= (usize)n;
+        }
+    }
+#endif
+}
+
+void output_flush(Output *out) {
+    if (out->size == 0)
+        return;
+    string slice = SV_LEN(out->data, out->size);
+    output_write_slices(out->fd, &slice, 1);
+    out->size = 0;
+}
+
+void output_write(Output *out, const char *data, usize size) {
+    if (size <= OUTPUT_BUFFER_SIZE - out->size) {
+        memcpy(out->data + out->size, data, size);
+        out->size += size;
+        return;
+    }
+    if (size < OUTPUT_BUFFER_SIZE) {
+        output_flush(out);
+        memcpy(out->data, data, size);
+        out->size = size;
+        return;
+    }
+
+    // Too large to be worth copying: send it along with what is buffered.
+    string slices[2] = {SV_LEN(out->data, out->size),
+                        SV_LEN((char *)data, size)};
+    output_write_slices(out->fd, slices, 2);
+    out->size = 0;
+}
+
+void output_printf(Output *out, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    va_list args2;
+    va_copy(args2, args);
+    usize room = OUTPUT_BUFFER_SIZE - out->size;
+    int size = vsnprintf(out->data + out->size, room, fmt, args);
+    va_end(args);
+
+    if (size < 0) {
+        va_end(args2);
+        return;
+    }
+    if ((usize)size < room) {
+        out->size += (usize)size;
+    } else if ((usize)size < OUTPUT_BUFFER_SIZE) {
+        output_flush(out);
+        vsnprintf(out->data, OUTPUT_BUFFER_SIZE, fmt, args2);
+        out->size = (usize)size;
+    } else {
+        char *text = malloc((usize)size + 1);
+        vsnprintf(text, (usize)size + 1, fmt, args2);
+        output_write(out, text, (usize)size);
+        free(text);
+    }
+    va_end(args2);
+}
@@ -0,0 +1,40 @@
+#ifndef _CYCLONE_OUTPUT_H
+#define _CYCLONE_OUTPUT_H
+
+#include "common.h"
+
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+typedef u8 OutputColor;
+enum {
+    OUTPUT_COLOR_AUTO,
+    OUTPUT_COLOR_ALWAYS,
+    OUTPUT_COLOR_NEVER,
+};
+
+// A buffered stream over a file descriptor. Writes are copied into `data`
+// and handed to the OS only when it fills up, when something too large to
+// buffer comes along (then both go out in one gathered write), or at exit.
+typedef struct {
+    int fd;
+    usize size;
+    char data[OUTPUT_BUFFER_SIZE];
+} Output;
+
+extern Output output_stdout;
+extern Output output_stderr;
+
+// Decides once whether `color` returns escape sequences: with AUTO they are
+// used when stderr is a terminal and NO_COLOR is not set. Also arranges for
+// both streams to be flushed at exit.
+void output_init(OutputColor mode);
+
+void output_write(Output *out, const char *data, usize size);
+void output_printf(Output *out, const char *fmt, ...);
+void output_flush(Output *out);
+
+static inline void output_sv(Output *out, string s) {
+    output_write(out, s.data, s.size);
+}
+
+#endif // _CYCLONE_OUTPUT_H
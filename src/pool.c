@@ -0,0 +1,198 @@
+#include <stdlib.h>
+
+#include "pool.h"
+#include "thread.h"
+
+#define POOL_DEQUE_MIN_CAPACITY 16
+
+typedef struct {
+    TaskFunc func;
+    rawptr arg;
+} Task;
+
+// The owner pushes and pops at the tail of the ring, thieves take from the
+// head. A task is a whole phase of a file, so a lock per deque costs
+// nothing next to the work it hands out.
+typedef struct {
+    Pool *pool;
+    Thread *thread;
+    Mutex *lock;
+    Task *tasks;
+    usize head, size, capacity;
+} Worker;
+
+struct Pool {
+    Worker *workers;
+    usize count;
+
+    // Guards everything below.
+    Mutex *lock;
+    // Signalled when a task is queued or the pool is stopping.
+    Cond *work;
+    // Broadcast when `pending` drops to zero.
+    Cond *idle;
+    usize queued;  // tasks waiting in a deque
+    usize pending; // tasks waiting or running
+    usize next;    // the worker that gets the next task from outside
+    bool stopping;
+};
+
+// The worker running on this thread, or NULL outside the pool.
+static __thread Worker *pool_worker;
+
+static void pool_push(Worker *worker, Task task) {
+    mutex_lock(worker->lock);
+    if (worker->size == worker->capacity) {
+        usize capacity = worker->capacity ? worker->capacity * 2
+                                          : POOL_DEQUE_MIN_CAPACITY;
+        Task *tasks = malloc(capacity * sizeof(Task));
+        for (usize i = 0; i < worker->size; i++)
+            tasks[i] = worker->tasks[(worker->head + i) % worker->capacity];
+        free(worker->tasks);
+        worker->tasks = tasks;
+        worker->head = 0;
+        worker->capacity = capacity;
+    }
+    worker->tasks[(worker->head + worker->size) % worker->capacity] = task;
+    worker->size++;
+    mutex_unlock(worker->lock);
+}
+
+static bool pool_pop(Worker *worker, Task *task) {
+    mutex_lock(worker->lock);
+    bool found = worker->size != 0;
+    if (found) {
+        worker->size--;
+        *task = worker->tasks[(worker->head + worker->size) % worker->capacity];
+    }
+    mutex_unlock(worker->lock);
+    return found;
+}
+
+static bool pool_steal(Worker *worker, Task *task) {
+    mutex_lock(worker->lock);
+    bool found = worker->size != 0;
+    if (found) {
+        *task = worker->tasks[worker->head];
+        worker->head = (worker->head + 1) % worker->capacity;
+        worker->size--;
+    }
+    mutex_unlock(worker->lock);
+    return found;
+}
+
+static bool pool_take(Worker *self, Task *task) {
+    if (pool_pop(self, task))
+        return true;
+    Pool *pool = self->pool;
+    usize index = (usize)(self - pool->workers);
+    for (usize i = 1; i < pool->count; i++)
+        if (pool_steal(&pool->workers[(index + i) % pool->count], task))
+            return true;
+    return false;
+}
+
+static void pool_run(rawptr arg) {
+    Worker *self = arg;
+    Pool *pool = self->pool;
+    pool_worker = self;
+
+    for (;;) {
+        Task task;
+        if (pool_take(self, &task)) {
+            mutex_lock(pool->lock);
+            pool->queued--;
+            mutex_unlock(pool->lock);
+
+            task.func(task.arg);
+
+            mutex_lock(pool->lock);
+            if (--pool->pending == 0)
+                cond_broadcast(pool->idle);
+            mutex_unlock(pool->lock);
+            continue;
+        }
+
+        // `queued` is counted before the task is pushed, so it can be seen
+        // non-zero with every deque empty for a moment; that just means
+        // another look.
+        mutex_lock(pool->lock);
+        while (pool->queued == 0 && !pool->stopping)
+            cond_wait(pool->work, pool->lock);
+        bool stop = pool->queued == 0 && pool->stopping;
+        mutex_unlock(pool->lock);
+        if (stop)
+            return;
+    }
+}
+
+Pool *pool_new(usize threads) {
+    ASSERT(threads > 0, "a pool needs at least one thread, got %zu",
+           threads);
+
+    Pool *pool = malloc(sizeof(*pool));
+    pool->workers = malloc(threads * sizeof(Worker));
+    pool->count = threads;
+    pool->lock = mutex_new();
+    pool->work = cond_new();
+    pool->idle = cond_new();
+    pool->queued = 0;
+    pool->pending = 0;
+    pool->next = 0;
+    pool->stopping = false;
+
+    for (usize i = 0; i < threads; i++) {
+        Worker *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->lock = mutex_new();
+        worker->tasks = NULL;
+        worker->head = 0;
+        worker->size = 0;
+        worker->capacity = 0;
+    }
+    // Only start the threads once every deque exists to steal from.
+    for (usize i = 0; i < threads; i++)
+        pool->workers[i].thread = thread_spawn(pool_run, &pool->workers[i]);
+    return pool;
+}
+
+void pool_free(Pool *pool) {
+    pool_wait(pool);
+
+    mutex_lock(pool->lock);
+    pool->stopping = true;
+    cond_broadcast(pool->work);
+    mutex_unlock(pool->lock);
+
+    for (usize i = 0; i < pool->count; i++) {
+        Worker *worker = &pool->workers[i];
+        thread_join(worker->thread);
+        mutex_free(worker->lock);
+        free(worker->tasks);
+    }
+    cond_free(pool->idle);
+    cond_free(pool->work);
+    mutex_free(pool->lock);
+    free(pool->workers);
+    free(pool);
+}
+
+void pool_submit(Pool *pool, TaskFunc func, rawptr arg) {
+    Worker *worker = pool_worker;
+    mutex_lock(pool->lock);
+    if (worker == NULL || worker->pool != pool)
+        worker = &pool->workers[pool->next++ % pool->count];
+    pool->queued++;
+    pool->pending++;
+    mutex_unlock(pool->lock);
+
+    pool_push(worker, (Task){func, arg});
+    cond_signal(pool->work);
+}
+
+void pool_wait(Pool *pool) {
+    mutex_lock(pool->lock);
+    while (pool->pending != 0)
+        cond_wait(pool->idle, pool->lock);
+    mutex_unlock(pool->lock);
+}
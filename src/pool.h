@@ -0,0 +1,22 @@
+#ifndef _CYCLONE_POOL_H
+#define _CYCLONE_POOL_H
+
+#include "common.h"
+
+// A fixed set of worker threads with a deque of tasks each. A worker runs
+// the newest task in its own deque first, so the follow-up work a task
+// queues stays on the same thread while its data is still in cache, and
+// when its deque is empty it steals the oldest task of another worker.
+typedef void (*TaskFunc)(rawptr arg);
+typedef struct Pool Pool;
+
+Pool *pool_new(usize threads);
+// Waits for every queued task, then stops and releases the workers.
+void pool_free(Pool *pool);
+// Queues `func(arg)`. A task queued from inside another task goes to the
+// calling worker's deque; others are dealt out to the workers in turn.
+void pool_submit(Pool *pool, TaskFunc func, rawptr arg);
+// Blocks until every task, including ones queued by other tasks, is done.
+void pool_wait(Pool *pool);
+
+#endif // _CYCLONE_POOL_H
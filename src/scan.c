@@ -0,0 +1,234 @@
+#include "scan.h"
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+ScanKernels scan_kernels;
+static const char *scan_isa = "scalar";
+
+static inline bool scan_is_ident(u8 c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_';
+}
+
+static usize scan_ident_scalar(const char *data, usize len) {
+    usize i = 0;
+    while (i < len && scan_is_ident((u8)data[i]))
+        i++;
+    return i;
+}
+
+static usize scan_digits_scalar(const char *data, usize len) {
+    usize i = 0;
+    while (i < len && (u8)(data[i] - '0') < 10)
+        i++;
+    return i;
+}
+
+static usize scan_spaces_scalar(const char *data, usize len) {
+    usize i = 0;
+    while (i < len && (data[i] == ' ' || data[i] == '\t' || data[i] == '\r'))
+        i++;
+    return i;
+}
+
+static usize scan_line_scalar(const char *data, usize len) {
+    const char *end = memchr(data, '\n', len);
+    return end ? (usize)(end - data) : len;
+}
+
+static usize scan_string_scalar(const char *data, usize len) {
+    usize i = 0;
+    while (i < len && data[i] != '"' && data[i] != '\\' && data[i] != '\n')
+        i++;
+    return i;
+}
+
+static usize scan_line_starts_scalar(const char *data, usize len, u32 base,
+                                     u32 *out) {
+    usize n = 0;
+    for (usize i = 0; i < len; i++)
+        if (data[i] == '\n')
+            out[n++] = base + (u32)i + 1;
+    return n;
+}
+
+#ifdef SCAN_X86
+
+// Byte-wise unsigned `lo <= x <= hi` using signed compares: shifting the
+// range down to start at -128 turns it into a single `<`.
+#define SSE2_IN_RANGE(x, lo, hi)                                               \
+    _mm_cmplt_epi8(_mm_add_epi8((x), _mm_set1_epi8((char)(0x80 - (lo)))),     \
+                   _mm_set1_epi8((char)(-128 + ((hi) - (lo) + 1))))
+#define AVX2_IN_RANGE(x, lo, hi)                                               \
+    _mm256_cmpgt_epi8(                                                         \
+        _mm256_set1_epi8((char)(-128 + ((hi) - (lo) + 1))),                    \
+        _mm256_add_epi8((x), _mm256_set1_epi8((char)(0x80 - (lo)))))
+
+static inline __m128i sse2_ident_mask(__m128i x) {
+    __m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+    __m128i alpha = SSE2_IN_RANGE(lower, 'a', 'z');
+    __m128i digit = SSE2_IN_RANGE(x, '0', '9');
+    __m128i under = _mm_cmpeq_epi8(x, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(alpha, digit), under);
+}
+
+static inline __m128i sse2_digit_mask(__m128i x) {
+    return SSE2_IN_RANGE(x, '0', '9');
+}
+
+static inline __m128i sse2_space_mask(__m128i x) {
+    __m128i space = _mm_cmpeq_epi8(x, _mm_set1_epi8(' '));
+    __m128i tab = _mm_cmpeq_epi8(x, _mm_set1_epi8('\t'));
+    __m128i cr = _mm_cmpeq_epi8(x, _mm_set1_epi8('\r'));
+    return _mm_or_si128(_mm_or_si128(space, tab), cr);
+}
+
+static inline __m128i sse2_line_mask(__m128i x) {
+    __m128i nl = _mm_cmpeq_epi8(x, _mm_set1_epi8('\n'));
+    return _mm_xor_si128(nl, _mm_set1_epi8(-1));
+}
+
+static inline __m128i sse2_string_mask(__m128i x) {
+    __m128i nl = _mm_cmpeq_epi8(x, _mm_set1_epi8('\n'));
+    __m128i quote = _mm_cmpeq_epi8(x, _mm_set1_epi8('"'));
+    __m128i backslash = _mm_cmpeq_epi8(x, _mm_set1_epi8('\\'));
+    return _mm_xor_si128(_mm_or_si128(_mm_or_si128(nl, quote), backslash),
+                         _mm_set1_epi8(-1));
+}
+
+// Each kernel classifies a block, and the first clear bit of the movemask is
+// where the run ends. The tail shorter than a block is finished by the
+// scalar version.
+#define SSE2_KERNEL(name, mask_fn)                                             \
+    static usize scan_##name##_sse2(const char *data, usize len) {             \
+        usize i = 0;                                                           \
+        for (; i + 16 <= len; i += 16) {                                       \
+            __m128i x = _mm_loadu_si128((const __m128i *)(data + i));          \
+            u32 bits = (u32)_mm_movemask_epi8(mask_fn(x)) ^ 0xffff;            \
+            if (bits != 0)                                                     \
+                return i + (usize)__builtin_ctz(bits);                         \
+        }                                                                      \
+        return i + scan_##name##_scalar(data + i, len - i);                    \
+    }
+
+SSE2_KERNEL(ident, sse2_ident_mask)
+SSE2_KERNEL(digits, sse2_digit_mask)
+SSE2_KERNEL(spaces, sse2_space_mask)
+SSE2_KERNEL(line, sse2_line_mask)
+SSE2_KERNEL(string, sse2_string_mask)
+
+// One offset per set bit, so the cost follows the number of lines rather
+// than a compare per byte.
+static usize scan_line_starts_sse2(const char *data, usize len, u32 base,
+                                   u32 *out) {
+    usize n = 0, i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(data + i));
+        u32 bits =
+            (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')));
+        for (; bits != 0; bits &= bits - 1)
+            out[n++] = base + (u32)(i + __builtin_ctz(bits)) + 1;
+    }
+    return n + scan_line_starts_scalar(data + i, len - i, base + (u32)i,
+                                       out + n);
+}
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i avx2_ident_mask(__m256i x) {
+    __m256i lower = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+    __m256i alpha = AVX2_IN_RANGE(lower, 'a', 'z');
+    __m256i digit = AVX2_IN_RANGE(x, '0', '9');
+    __m256i under = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_'));
+    return _mm256_or_si256(_mm256_or_si256(alpha, digit), under);
+}
+
+AVX2 static inline __m256i avx2_digit_mask(__m256i x) {
+    return AVX2_IN_RANGE(x, '0', '9');
+}
+
+AVX2 static inline __m256i avx2_space_mask(__m256i x) {
+    __m256i space = _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' '));
+    __m256i tab = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\t'));
+    __m256i cr = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\r'));
+    return _mm256_or_si256(_mm256_or_si256(space, tab), cr);
+}
+
+AVX2 static inline __m256i avx2_line_mask(__m256i x) {
+    __m256i nl = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n'));
+    return _mm256_xor_si256(nl, _mm256_set1_epi8(-1));
+}
+
+AVX2 static inline __m256i avx2_string_mask(__m256i x) {
+    __m256i nl = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n'));
+    __m256i quote = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('"'));
+    __m256i backslash = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\'));
+    return _mm256_xor_si256(
+        _mm256_or_si256(_mm256_or_si256(nl, quote), backslash),
+        _mm256_set1_epi8(-1));
+}
+
+#define AVX2_KERNEL(name, mask_fn)                                             \
+    AVX2 static usize scan_##name##_avx2(const char *data, usize len) {        \
+        usize i = 0;                                                           \
+        for (; i + 32 <= len; i += 32) {                                       \
+            __m256i x = _mm256_loadu_si256((const __m256i *)(data + i));       \
+            u32 bits = ~(u32)_mm256_movemask_epi8(mask_fn(x));                 \
+            if (bits != 0)                                                     \
+                return i + (usize)__builtin_ctz(bits);                         \
+        }                                                                      \
+        return i + scan_##name##_sse2(data + i, len - i);                      \
+    }
+
+AVX2_KERNEL(ident, avx2_ident_mask)
+AVX2_KERNEL(digits, avx2_digit_mask)
+AVX2_KERNEL(spaces, avx2_space_mask)
+AVX2_KERNEL(line, avx2_line_mask)
+AVX2_KERNEL(string, avx2_string_mask)
+
+AVX2 static usize scan_line_starts_avx2(const char *data, usize len, u32 base,
+                                        u32 *out) {
+    usize n = 0, i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(data + i));
+        u32 bits = (u32)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')));
+        for (; bits != 0; bits &= bits - 1)
+            out[n++] = base + (u32)(i + __builtin_ctz(bits)) + 1;
+    }
+    return n + scan_line_starts_sse2(data + i, len - i, base + (u32)i, out + n);
+}
+
+#endif // SCAN_X86
+
+void scan_init(void) {
+    if (scan_kernels.ident != NULL)
+        return;
+
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        scan_kernels = (ScanKernels){
+            scan_ident_avx2, scan_digits_avx2, scan_spaces_avx2,
+            scan_line_avx2,  scan_string_avx2, scan_line_starts_avx2,
+        };
+        scan_isa = "avx2";
+        return;
+    }
+    scan_kernels = (ScanKernels){
+        scan_ident_sse2, scan_digits_sse2, scan_spaces_sse2,
+        scan_line_sse2,  scan_string_sse2, scan_line_starts_sse2,
+    };
+    scan_isa = "sse2";
+#else
+    scan_kernels = (ScanKernels){
+        scan_ident_scalar, scan_digits_scalar, scan_spaces_scalar,
+        scan_line_scalar,  scan_string_scalar, scan_line_starts_scalar,
+    };
+#endif
+}
+
+const char *scan_isa_name(void) { return scan_isa; }
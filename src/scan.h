@@ -0,0 +1,31 @@
+#ifndef _CYCLONE_SCAN_H
+#define _CYCLONE_SCAN_H
+
+#include "common.h"
+
+// Run-length kernels for the lexer's hot loops. Each returns how many
+// leading bytes of [data, data + len) belong to the run, so `len` means the
+// run continues past the end of the buffer.
+typedef usize (*ScanKernel)(const char *data, usize len);
+// Writes `base + i + 1` to `out` for every '\n' at `data[i]` and returns how
+// many were written; `out` needs room for `len` entries.
+typedef usize (*ScanLineStarts)(const char *data, usize len, u32 base,
+                                u32 *out);
+
+typedef struct {
+    ScanKernel ident;  // [A-Za-z0-9_]
+    ScanKernel digits; // [0-9]
+    ScanKernel spaces; // ' ', '\t', '\r'
+    ScanKernel line;   // anything but '\n'
+    ScanKernel string; // anything but '"', '\\' and '\n'
+    ScanLineStarts line_starts;
+} ScanKernels;
+
+// Picks the widest implementation the CPU supports (AVX2, SSE2 or scalar).
+// Must be called before `scan_kernels` is used; repeated calls are no-ops.
+void scan_init(void);
+const char *scan_isa_name(void);
+
+extern ScanKernels scan_kernels;
+
+#endif // _CYCLONE_SCAN_H
@@ -0,0 +1,168 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdlib.h>
+
+#include "thread.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+struct Thread {
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    ThreadFunc func;
+    rawptr arg;
+};
+
+#ifdef _WIN32
+static DWORD WINAPI thread_entry(LPVOID arg) {
+    Thread *thread = arg;
+    thread->func(thread->arg);
+    return 0;
+}
+#else
+static void *thread_entry(void *arg) {
+    Thread *thread = arg;
+    thread->func(thread->arg);
+    return NULL;
+}
+#endif
+
+Thread *thread_spawn(ThreadFunc func, rawptr arg) {
+    Thread *thread = malloc(sizeof(*thread));
+    thread->func = func;
+    thread->arg = arg;
+#ifdef _WIN32
+    thread->handle = CreateThread(NULL, 0, thread_entry, thread, 0, NULL);
+    ASSERT(thread->handle != NULL, "could not spawn thread (%lu)",
+           GetLastError());
+#else
+    int result = pthread_create(&thread->handle, NULL, thread_entry, thread);
+    ASSERT(result == 0, "could not spawn thread (%d)", result);
+#endif
+    return thread;
+}
+
+void thread_join(Thread *thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+    free(thread);
+}
+
+usize thread_hardware_concurrency(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (usize)count : 1;
+#endif
+}
+
+struct Mutex {
+#ifdef _WIN32
+    CRITICAL_SECTION handle;
+#else
+    pthread_mutex_t handle;
+#endif
+};
+
+Mutex *mutex_new(void) {
+    Mutex *mutex = malloc(sizeof(*mutex));
+#ifdef _WIN32
+    InitializeCriticalSection(&mutex->handle);
+#else
+    int result = pthread_mutex_init(&mutex->handle, NULL);
+    ASSERT(result == 0, "could not create mutex (%d)", result);
+#endif
+    return mutex;
+}
+
+void mutex_free(Mutex *mutex) {
+#ifdef _WIN32
+    DeleteCriticalSection(&mutex->handle);
+#else
+    pthread_mutex_destroy(&mutex->handle);
+#endif
+    free(mutex);
+}
+
+void mutex_lock(Mutex *mutex) {
+#ifdef _WIN32
+    EnterCriticalSection(&mutex->handle);
+#else
+    pthread_mutex_lock(&mutex->handle);
+#endif
+}
+
+void mutex_unlock(Mutex *mutex) {
+#ifdef _WIN32
+    LeaveCriticalSection(&mutex->handle);
+#else
+    pthread_mutex_unlock(&mutex->handle);
+#endif
+}
+
+struct Cond {
+#ifdef _WIN32
+    CONDITION_VARIABLE handle;
+#else
+    pthread_cond_t handle;
+#endif
+};
+
+Cond *cond_new(void) {
+    Cond *cond = malloc(sizeof(*cond));
+#ifdef _WIN32
+    InitializeConditionVariable(&cond->handle);
+#else
+    int result = pthread_cond_init(&cond->handle, NULL);
+    ASSERT(result == 0, "could not create condition variable (%d)", result);
+#endif
+    return cond;
+}
+
+void cond_free(Cond *cond) {
+#ifndef _WIN32
+    pthread_cond_destroy(&cond->handle);
+#endif
+    free(cond);
+}
+
+void cond_wait(Cond *cond, Mutex *mutex) {
+#ifdef _WIN32
+    SleepConditionVariableCS(&cond->handle, &mutex->handle, INFINITE);
+#else
+    pthread_cond_wait(&cond->handle, &mutex->handle);
+#endif
+}
+
+void cond_signal(Cond *cond) {
+#ifdef _WIN32
+    WakeConditionVariable(&cond->handle);
+#else
+    pthread_cond_signal(&cond->handle);
+#endif
+}
+
+void cond_broadcast(Cond *cond) {
+#ifdef _WIN32
+    WakeAllConditionVariable(&cond->handle);
+#else
+    pthread_cond_broadcast(&cond->handle);
+#endif
+}
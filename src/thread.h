@@ -0,0 +1,31 @@
+#ifndef _CYCLONE_THREAD_H
+#define _CYCLONE_THREAD_H
+
+#include "common.h"
+
+typedef void (*ThreadFunc)(rawptr arg);
+typedef struct Thread Thread;
+
+Thread *thread_spawn(ThreadFunc func, rawptr arg);
+// Waits for the thread to finish and releases it.
+void thread_join(Thread *thread);
+
+usize thread_hardware_concurrency(void);
+
+typedef struct Mutex Mutex;
+typedef struct Cond Cond;
+
+Mutex *mutex_new(void);
+void mutex_free(Mutex *mutex);
+void mutex_lock(Mutex *mutex);
+void mutex_unlock(Mutex *mutex);
+
+Cond *cond_new(void);
+void cond_free(Cond *cond);
+// Releases `mutex`, which the caller holds, while waiting. Wakeups may be
+// spurious, so callers recheck their condition in a loop.
+void cond_wait(Cond *cond, Mutex *mutex);
+void cond_signal(Cond *cond);
+void cond_broadcast(Cond *cond);
+
+#endif // _CYCLONE_THREAD_H
@@ -2,6 +2,8 @@
 #define _CYCLONE_TOKEN_H
 
 #include "common.h"
+#include "intern.h"
+#include "literal.h"
 #include "location.h"
 #include "vector.h"
 
@@ -10,6 +12,8 @@ enum {
 #define TOKEN(id, name) TOKEN_##id,
 #include "tokens.def"
 #undef TOKEN
+
+    TOKEN_COUNT,
 };
 
 static inline const char *token_kind_to_string(TokenKind type) {
@@ -25,6 +29,10 @@ typedef struct {
     TokenKind kind;
     string lexeme;
     Location loc;
+    // Interned name of a TOKEN_IDENT, SYMBOL_NONE for anything else.
+    Symbol symbol;
+    // Decoded value of a literal, when the tokenizer has a literal pool.
+    LiteralId literal;
 } Token;
 
 #endif // _CYCLONE_TOKEN_H
\ No newline at end of file
@@ -2,523 +2,987 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "scan.h"
+#include "thread.h"
 #include "tokenizer.h"
 
+typedef u8 CharClass;
+enum {
+    CHAR_OTHER,
+    CHAR_SPACE,
+    CHAR_NEWLINE,
+    CHAR_IDENT,
+    CHAR_DIGIT,
+    CHAR_QUOTE,
+    CHAR_APOSTROPHE,
+    CHAR_PUNCT,
+};
+
+#define LEXER_MAX_STATES 64
+#define LEXER_KEYWORD_MAX_BITS 8
+
+typedef struct {
+    const char *spelling;
+    u8 len;
+    TokenKind kind;
+} Keyword;
+
+// Tables derived from tokens.def: a maximal-munch automaton over every
+// punctuation spelling, a classifier for the first byte of a token, and a
+// collision-free hash table over the keywords. State 0 is the start state
+// and a zero transition means "no edge".
+static struct {
+    bool ready;
+    u8 state_count;
+    // How many bytes past its end lexing a token may read.
+    u8 lookahead;
+    u8 next[LEXER_MAX_STATES][128];
+    TokenKind accept[LEXER_MAX_STATES];
+    CharClass classes[256];
+
+    Keyword keywords[1 << LEXER_KEYWORD_MAX_BITS];
+    u32 keyword_seed;
+    u8 keyword_shift;
+} lexer;
+
+// Placeholders such as "<ident>" and keywords have their own scanners.
+static bool lexer_is_punct(const char *name) {
+    if (name[0] == '<' && isalpha((u8)name[1]))
+        return false;
+    return !isalpha((u8)name[0]) && name[0] != '_';
+}
+
+static bool lexer_is_keyword(const char *name) {
+    return isalpha((u8)name[0]) || name[0] == '_';
+}
+
+// Mixes the length with the first, second and last bytes, which is enough to
+// tell every keyword apart; the seed is searched for once at startup.
+static inline u32 lexer_keyword_hash(const char *s, usize len, u32 seed,
+                                     u8 shift) {
+    u32 key = (u32)(u8)s[0] | (u32)(u8)s[len > 1] << 8 |
+              (u32)(u8)s[len - 1] << 16 | (u32)len << 24;
+    return (key * seed) >> shift;
+}
+
+static bool lexer_try_keyword_seed(u32 seed, u8 bits) {
+    u8 shift = 32 - bits;
+    memset(lexer.keywords, 0, sizeof(lexer.keywords));
+    for (TokenKind kind = 0; kind < TOKEN_COUNT; kind++) {
+        const char *name = token_kind_to_string(kind);
+        if (!lexer_is_keyword(name))
+            continue;
+
+        usize len = strlen(name);
+        Keyword *slot =
+            &lexer.keywords[lexer_keyword_hash(name, len, seed, shift)];
+        if (slot->len != 0)
+            return false;
+        *slot = (Keyword){name, (u8)len, kind};
+    }
+    lexer.keyword_seed = seed;
+    lexer.keyword_shift = shift;
+    return true;
+}
+
+static void lexer_init_keywords(void) {
+    usize count = 0;
+    for (TokenKind kind = 0; kind < TOKEN_COUNT; kind++)
+        count += lexer_is_keyword(token_kind_to_string(kind));
+
+    u8 bits = 1;
+    while ((1u << bits) < count * 2)
+        bits++;
+
+    for (; bits <= LEXER_KEYWORD_MAX_BITS; bits++) {
+        u32 seed = 0x9e3779b9;
+        for (usize attempt = 0; attempt < 4096; attempt++) {
+            if (lexer_try_keyword_seed(seed | 1, bits))
+                return;
+            seed = seed * 1664525 + 1013904223;
+        }
+    }
+    ASSERT(false, "no perfect hash for the keywords in %s", "tokens.def");
+}
+
+static void lexer_init(void) {
+    if (lexer.ready)
+        return;
+
+    lexer.state_count = 1;
+    for (usize i = 0; i < LEXER_MAX_STATES; i++)
+        lexer.accept[i] = TOKEN_UNKNOWN;
+
+    for (TokenKind kind = 0; kind < TOKEN_COUNT; kind++) {
+        const char *name = token_kind_to_string(kind);
+        if (!lexer_is_punct(name))
+            continue;
+
+        u8 state = 0;
+        for (const char *p = name; *p != '\0'; p++) {
+            u8 c = (u8)*p;
+            if (!lexer.next[state][c]) {
+                ASSERT(lexer.state_count < LEXER_MAX_STATES,
+                       "too many punctuation states in %s", "tokens.def");
+                lexer.next[state][c] = lexer.state_count++;
+            }
+            state = lexer.next[state][c];
+        }
+        lexer.accept[state] = kind;
+
+        // The automaton reads one byte past the longest spelling before
+        // giving up, and a number peeks two bytes for "1.5" versus "1..".
+        usize len = strlen(name);
+        if (len > lexer.lookahead)
+            lexer.lookahead = (u8)len;
+    }
+    if (lexer.lookahead < 2)
+        lexer.lookahead = 2;
+
+    lexer_init_keywords();
+    scan_init();
+
+    for (usize c = 0; c < 256; c++) {
+        if (c == ' ' || c == '\t' || c == '\r')
+            lexer.classes[c] = CHAR_SPACE;
+        else if (c == '\n')
+            lexer.classes[c] = CHAR_NEWLINE;
+        else if (isalpha((int)c) || c == '_')
+            lexer.classes[c] = CHAR_IDENT;
+        else if (isdigit((int)c))
+            lexer.classes[c] = CHAR_DIGIT;
+        else if (c == '"')
+            lexer.classes[c] = CHAR_QUOTE;
+        else if (c == '\'')
+            lexer.classes[c] = CHAR_APOSTROPHE;
+        else if (c < 128 && lexer.next[0][c])
+            lexer.classes[c] = CHAR_PUNCT;
+        else
+            lexer.classes[c] = CHAR_OTHER;
+    }
+
+    lexer.ready = true;
+}
+
+void tokenizer_init(void) { lexer_init(); }
+
 Tokenizer *tokenizer_new(File *file) {
+    lexer_init();
+
     Tokenizer *t = malloc(sizeof(Tokenizer));
     t->file = file;
     t->pos = 0;
-    t->line = 1;
-    t->column = 1;
-    vec_init(&t->errors);
+    t->buffer = file->contents.data;
+    t->buffer_start = 0;
+    t->buffer_len = vec_len(&file->contents);
+    t->token_start = 0;
+    vec_init_tag(&t->window, MEM_TOKENIZER);
+    t->at_eof = file->backing != FILE_BACKING_STREAM;
+    smallvec_init_tag(&t->errors, MEM_TOKENIZER);
+    arena_init(&t->messages, MEM_TOKENIZER);
+    t->interner = NULL;
+    t->literal_pool = NULL;
+    t->literal = LITERAL_NONE;
     return t;
 }
 
 void tokenizer_free(Tokenizer *tokenizer) {
-    file_free(tokenizer->file);
-    vec_free(&tokenizer->errors);
+    vec_free(&tokenizer->window);
+    smallvec_free(&tokenizer->errors);
+    arena_free(&tokenizer->messages);
     free(tokenizer);
 }
 
+// Drops everything before the current token from the window and reads the
+// next chunk behind it. The window only grows past one chunk when a single
+// token is longer than that.
+static void tokenizer_refill(Tokenizer *tokenizer) {
+    usize keep = tokenizer->token_start - tokenizer->buffer_start;
+    usize remaining = tokenizer->window.size - keep;
+    // The window is still unallocated before the first chunk.
+    if (remaining > 0)
+        memmove(tokenizer->window.data, tokenizer->window.data + keep,
+                remaining);
+    tokenizer->buffer_start += keep;
+    tokenizer->window.size = remaining;
+
+    if (tokenizer->window.capacity < remaining + TOKENIZER_CHUNK_SIZE) {
+        usize capacity = remaining + TOKENIZER_CHUNK_SIZE;
+        tokenizer->window.data =
+            mem_realloc(tokenizer->window.tag, tokenizer->window.data,
+                        tokenizer->window.capacity, capacity);
+        tokenizer->window.capacity = capacity;
+    }
+
+    usize n = fread(tokenizer->window.data + remaining, 1,
+                    TOKENIZER_CHUNK_SIZE, tokenizer->file->stream);
+    tokenizer->window.size += n;
+    if (n < TOKENIZER_CHUNK_SIZE)
+        tokenizer->at_eof = true;
+
+    // The bytes are gone once the window moves on, so validate them and
+    // index their lines now.
+    char *data = tokenizer->window.data + remaining;
+    usize base = tokenizer->buffer_start + remaining;
+    file_validate_utf8(tokenizer->file, data, n, base, tokenizer->at_eof);
+    file_index_lines(tokenizer->file, data, n, base);
+
+    tokenizer->buffer = tokenizer->window.data;
+    tokenizer->buffer_len = tokenizer->window.size;
+}
+
+// Makes `pos` resident, returning false once it is past the end of the input.
+static inline bool tokenizer_fill(Tokenizer *tokenizer, usize pos) {
+    while (pos - tokenizer->buffer_start >= tokenizer->buffer_len) {
+        if (tokenizer->at_eof)
+            return false;
+        tokenizer_refill(tokenizer);
+    }
+    return true;
+}
+
+static inline bool tokenizer_at_end(Tokenizer *tokenizer) {
+    return !tokenizer_fill(tokenizer, tokenizer->pos);
+}
+
+static inline string tokenizer_slice(Tokenizer *tokenizer, usize start,
+                                     usize len) {
+    return SV_LEN((char *)tokenizer->buffer + (start - tokenizer->buffer_start),
+                  len);
+}
+
+// Reads past the end of the input yield '\0' instead of touching memory
+// outside the source, since mapped files have no terminator.
 char tokenizer_advance(Tokenizer *tokenizer) {
-    char c = *vec_get(&tokenizer->file->contents, tokenizer->pos);
+    if (!tokenizer_fill(tokenizer, tokenizer->pos))
+        return '\0';
+    char c = tokenizer->buffer[tokenizer->pos - tokenizer->buffer_start];
     tokenizer->pos++;
     return c;
 }
 
 char tokenizer_peek(Tokenizer *tokenizer) {
-    return *vec_get(&tokenizer->file->contents, tokenizer->pos);
+    if (!tokenizer_fill(tokenizer, tokenizer->pos))
+        return '\0';
+    return tokenizer->buffer[tokenizer->pos - tokenizer->buffer_start];
 }
 
 char tokenizer_peek_next(Tokenizer *tokenizer) {
-    return *vec_get(&tokenizer->file->contents, tokenizer->pos + 1);
+    if (!tokenizer_fill(tokenizer, tokenizer->pos + 1))
+        return '\0';
+    return tokenizer->buffer[tokenizer->pos + 1 - tokenizer->buffer_start];
 }
 
 static Location tokenizer_location(Tokenizer *tokenizer) {
-    return LOC(tokenizer->file->id, tokenizer->line, tokenizer->column);
+    return LOC(tokenizer->file->id, (u32)tokenizer->pos);
 }
 
-Token tokenizer_next_token(Tokenizer *tokenizer) {
-    Token token = {0};
-    token.kind = TOKEN_EOF;
+// Advances over the run `kernel` accepts, refilling the window as needed.
+static void tokenizer_scan(Tokenizer *tokenizer, ScanKernel kernel) {
+    for (;;) {
+        if (!tokenizer_fill(tokenizer, tokenizer->pos))
+            return;
+        usize offset = tokenizer->pos - tokenizer->buffer_start;
+        usize avail = tokenizer->buffer_len - offset;
+        usize n = kernel(tokenizer->buffer + offset, avail);
+        tokenizer->pos += n;
+        if (n < avail)
+            return;
+    }
+}
 
-    if (tokenizer->pos >= vec_len(&tokenizer->file->contents)) {
-        return token;
+static void tokenizer_skip_comment(Tokenizer *tokenizer) {
+    tokenizer->pos += 2;
+    for (;;) {
+        tokenizer->token_start = tokenizer->pos;
+        if (!tokenizer_fill(tokenizer, tokenizer->pos))
+            return;
+        usize offset = tokenizer->pos - tokenizer->buffer_start;
+        usize avail = tokenizer->buffer_len - offset;
+        usize n = scan_kernels.line(tokenizer->buffer + offset, avail);
+        tokenizer->pos += n;
+        if (n < avail)
+            return;
     }
+}
 
-    char c = tokenizer_peek(tokenizer);
-    token.loc = tokenizer_location(tokenizer);
-    switch (c) {
-    case '\r':
-    case '\t':
-    case ' ': {
-        tokenizer_advance(tokenizer);
-        tokenizer->column++;
-        return tokenizer_next_token(tokenizer);
-    } break;
-    case '\n': {
-        tokenizer_advance(tokenizer);
-        tokenizer->column = 1;
-        tokenizer->line++;
-        return tokenizer_next_token(tokenizer);
-    } break;
-    case '+': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_PLUS;
-        token.lexeme = SV("+");
-        tokenizer->column++;
-        if (tokenizer_peek(tokenizer) == '+') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_PLUS_PLUS;
-            token.lexeme = SV("++");
-            tokenizer->column++;
-        } else if (tokenizer_peek(tokenizer) == '=') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_PLUS_EQ;
-            token.lexeme = SV("+=");
-            tokenizer->column++;
-        }
-    } break;
-    case '-': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_MINUS;
-        token.lexeme = SV("-");
-        tokenizer->column++;
-        if (tokenizer_peek(tokenizer) == '-') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_MINUS_MINUS;
-            token.lexeme = SV("--");
-            tokenizer->column++;
-        } else if (tokenizer_peek(tokenizer) == '=') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_MINUS_EQ;
-            token.lexeme = SV("-=");
-            tokenizer->column++;
-        }
-    } break;
-    case '*': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_STAR;
-        token.lexeme = SV("*");
-        tokenizer->column++;
-        if (tokenizer_peek(tokenizer) == '=') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_STAR_EQ;
-            token.lexeme = SV("*=");
-            tokenizer->column++;
-        }
-    } break;
-    case '/': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_SLASH;
-        token.lexeme = SV("/");
-        tokenizer->column++;
-        if (tokenizer_peek(tokenizer) == '=') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_SLASH_EQ;
-            token.lexeme = SV("/=");
-            tokenizer->column++;
-        } else if (tokenizer_peek(tokenizer) == '/') {
-            tokenizer_advance(tokenizer);
-            tokenizer->column++;
-            for (;;) {
-                if (tokenizer->pos >= vec_len(&tokenizer->file->contents)) {
-                    break;
-                }
-                char c = tokenizer_peek(tokenizer);
-                if (c == '\n') {
-                    break;
-                }
-                tokenizer_advance(tokenizer);
-                tokenizer->column++;
-            }
-            return tokenizer_next_token(tokenizer);
-        }
-    } break;
-    case '%': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_PERCENT;
-        token.lexeme = SV("%");
-        tokenizer->column++;
-        if (tokenizer_peek(tokenizer) == '=') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_PERCENT_EQ;
-            token.lexeme = SV("%=");
-            tokenizer->column++;
+static void tokenizer_skip_trivia(Tokenizer *tokenizer) {
+    for (;;) {
+        tokenizer->token_start = tokenizer->pos;
+        char c = tokenizer_peek(tokenizer);
+        switch (lexer.classes[(u8)c]) {
+        case CHAR_SPACE: {
+            tokenizer_scan(tokenizer, scan_kernels.spaces);
+        } break;
+        case CHAR_NEWLINE: {
+            tokenizer->pos++;
+        } break;
+        case CHAR_PUNCT: {
+            if (c != '/' || tokenizer_peek_next(tokenizer) != '/')
+                return;
+            tokenizer_skip_comment(tokenizer);
+        } break;
+        default:
+            return;
         }
-    } break;
-    case '=': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_EQ;
-        token.lexeme = SV("=");
-        tokenizer->column++;
-        if (tokenizer_peek(tokenizer) == '=') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_EQ_EQ;
-            token.lexeme = SV("==");
-            tokenizer->column++;
-        }
-    } break;
-    case '!': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_BANG;
-        token.lexeme = SV("!");
-        tokenizer->column++;
-        if (tokenizer_peek(tokenizer) == '=') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_BANG_EQ;
-            token.lexeme = SV("!=");
-            tokenizer->column++;
-        }
-    } break;
-    case '<': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_LT;
-        token.lexeme = SV("<");
-        tokenizer->column++;
-        if (tokenizer_peek(tokenizer) == '=') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_LT_EQ;
-            token.lexeme = SV("<=");
-            tokenizer->column++;
-        } else if (tokenizer_peek(tokenizer) == '<') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_LSHIFT;
-            token.lexeme = SV("<<");
-            tokenizer->column++;
-            if (tokenizer_peek(tokenizer) == '=') {
-                tokenizer_advance(tokenizer);
-                token.kind = TOKEN_LSHIFT_EQ;
-                token.lexeme = SV("<<=");
-                tokenizer->column++;
-            }
-        }
-    } break;
-    case '>': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_GT;
-        token.lexeme = SV(">");
-        tokenizer->column++;
-        if (tokenizer_peek(tokenizer) == '=') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_GT_EQ;
-            token.lexeme = SV(">=");
-            tokenizer->column++;
-        } else if (tokenizer_peek(tokenizer) == '>') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_RSHIFT;
-            token.lexeme = SV(">>");
-            tokenizer->column++;
-            if (tokenizer_peek(tokenizer) == '=') {
-                tokenizer_advance(tokenizer);
-                token.kind = TOKEN_RSHIFT_EQ;
-                token.lexeme = SV(">>=");
-                tokenizer->column++;
-            }
-        }
-    } break;
-    case '&': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_AMP;
-        token.lexeme = SV("&");
-        tokenizer->column++;
-        if (tokenizer_peek(tokenizer) == '&') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_AMP_AMP;
-            token.lexeme = SV("&&");
-            tokenizer->column++;
-        } else if (tokenizer_peek(tokenizer) == '=') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_AMP_EQ;
-            token.lexeme = SV("&=");
-            tokenizer->column++;
+    }
+}
+
+// Consumes a whole codepoint, so a multi-byte character is reported once.
+// Its length follows from the lead byte, since the source was validated.
+static TokenKind tokenizer_lex_unknown(Tokenizer *tokenizer) {
+    u8 c = (u8)tokenizer_peek(tokenizer);
+    usize len = c < 0xC0 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+    while (len > 1 && !tokenizer_fill(tokenizer, tokenizer->pos + len - 1))
+        len--;
+    string text = tokenizer_slice(tokenizer, tokenizer->pos, len);
+    ERR(tokenizer, "unexpected character '" SV_FMT "'", SV_ARG(text));
+    tokenizer->pos += len;
+    return TOKEN_UNKNOWN;
+}
+
+static TokenKind tokenizer_lex_punct(Tokenizer *tokenizer) {
+    usize start = tokenizer->pos;
+    usize len = 0;
+    TokenKind kind = TOKEN_UNKNOWN;
+    u8 state = 0;
+    for (usize i = 0;; i++) {
+        if (!tokenizer_fill(tokenizer, start + i))
+            break;
+        u8 c = tokenizer->buffer[start + i - tokenizer->buffer_start];
+        if (c >= 128 || !lexer.next[state][c])
+            break;
+        state = lexer.next[state][c];
+        if (lexer.accept[state] != TOKEN_UNKNOWN) {
+            kind = lexer.accept[state];
+            len = i + 1;
         }
-    } break;
-    case '|': {
+    }
+    if (len == 0) {
+        return tokenizer_lex_unknown(tokenizer);
+    }
+    tokenizer->pos += len;
+    return kind;
+}
+
+static TokenKind tokenizer_lex_ident(Tokenizer *tokenizer) {
+    usize start = tokenizer->pos;
+    tokenizer_scan(tokenizer, scan_kernels.ident);
+
+    string lexeme = tokenizer_slice(tokenizer, start, tokenizer->pos - start);
+    Keyword *keyword = &lexer.keywords[lexer_keyword_hash(
+        lexeme.data, lexeme.size, lexer.keyword_seed, lexer.keyword_shift)];
+    if (keyword->len == lexeme.size &&
+        memcmp(keyword->spelling, lexeme.data, keyword->len) == 0)
+        return keyword->kind;
+    return TOKEN_IDENT;
+}
+
+// Numbers are converted as they are lexed, so that out-of-range integers are
+// reported whether or not there is a literal pool to keep the value in.
+static TokenKind tokenizer_lex_number(Tokenizer *tokenizer) {
+    usize start = tokenizer->pos;
+    tokenizer_scan(tokenizer, scan_kernels.digits);
+    if (tokenizer_peek(tokenizer) == '.' &&
+        isdigit((u8)tokenizer_peek_next(tokenizer))) {
         tokenizer_advance(tokenizer);
-        token.kind = TOKEN_PIPE;
-        token.lexeme = SV("|");
-        tokenizer->column++;
-        if (tokenizer_peek(tokenizer) == '|') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_PIPE_PIPE;
-            token.lexeme = SV("||");
-            tokenizer->column++;
-        } else if (tokenizer_peek(tokenizer) == '=') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_PIPE_EQ;
-            token.lexeme = SV("|=");
-            tokenizer->column++;
+        tokenizer_scan(tokenizer, scan_kernels.digits);
+        if (tokenizer->literal_pool != NULL) {
+            Literal literal = {.kind = LITERAL_FLOAT};
+            literal.as.f = literal_parse_float(
+                tokenizer_slice(tokenizer, start, tokenizer->pos - start));
+            tokenizer->literal =
+                literal_pool_add(tokenizer->literal_pool, literal);
         }
-    } break;
-    case '^': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_CARET;
-        token.lexeme = SV("^");
-        tokenizer->column++;
-        if (tokenizer_peek(tokenizer) == '=') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_CARET_EQ;
-            token.lexeme = SV("^=");
-            tokenizer->column++;
+        return TOKEN_FLOAT_LIT;
+    }
+
+    Literal literal = {.kind = LITERAL_INT};
+    string text = tokenizer_slice(tokenizer, start, tokenizer->pos - start);
+    if (!literal_parse_int(text, &literal.as.i))
+        ERR(tokenizer, "integer literal '" SV_FMT "' is too large",
+            SV_ARG(text));
+    else if (tokenizer->literal_pool != NULL)
+        tokenizer->literal = literal_pool_add(tokenizer->literal_pool, literal);
+    return TOKEN_INT_LIT;
+}
+
+// Checks the escape after a backslash. One at the end of a line is left for
+// the caller to report as unterminated.
+static void tokenizer_lex_escape(Tokenizer *tokenizer) {
+    if (tokenizer_at_end(tokenizer) || tokenizer_peek(tokenizer) == '\n')
+        return;
+    char code = tokenizer_advance(tokenizer);
+    if (literal_escape(code) < 0)
+        ERR(tokenizer, "unknown escape sequence '\\%c'", code);
+}
+
+// The body between the quotes of the token just lexed.
+static inline string tokenizer_literal_body(Tokenizer *tokenizer) {
+    return tokenizer_slice(tokenizer, tokenizer->token_start + 1,
+                           tokenizer->pos - tokenizer->token_start - 2);
+}
+
+static TokenKind tokenizer_lex_string(Tokenizer *tokenizer) {
+    tokenizer_advance(tokenizer);
+    for (;;) {
+        tokenizer_scan(tokenizer, scan_kernels.string);
+        if (tokenizer_at_end(tokenizer) ||
+            tokenizer_peek(tokenizer) == '\n') {
+            ERR_NO_VARARG(tokenizer, "unterminated string literal");
+            return TOKEN_UNKNOWN;
         }
-    } break;
-    case '~': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_TILDE;
-        token.lexeme = SV("~");
-        tokenizer->column++;
-    } break;
-    case '(': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_LPAREN;
-        token.lexeme = SV("(");
-        tokenizer->column++;
-    } break;
-    case ')': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_RPAREN;
-        token.lexeme = SV(")");
-        tokenizer->column++;
-    } break;
-    case '{': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_LBRACE;
-        token.lexeme = SV("{");
-        tokenizer->column++;
-    } break;
-    case '}': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_RBRACE;
-        token.lexeme = SV("}");
-        tokenizer->column++;
-    } break;
-    case '[': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_LBRACKET;
-        token.lexeme = SV("[");
-        tokenizer->column++;
-    } break;
-    case ']': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_RBRACKET;
-        token.lexeme = SV("]");
-        tokenizer->column++;
-    } break;
-    case ':': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_COLON;
-        token.lexeme = SV(":");
-        tokenizer->column++;
-        if (tokenizer_peek(tokenizer) == '=') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_COLON_EQ;
-            token.lexeme = SV(":=");
-            tokenizer->column++;
+        if (tokenizer_advance(tokenizer) == '"')
+            break;
+        tokenizer_lex_escape(tokenizer);
+    }
+
+    if (tokenizer->literal_pool != NULL)
+        tokenizer->literal = literal_pool_string(
+            tokenizer->literal_pool, tokenizer_literal_body(tokenizer));
+    return TOKEN_STRING_LIT;
+}
+
+static TokenKind tokenizer_lex_char(Tokenizer *tokenizer) {
+    tokenizer_advance(tokenizer);
+    usize chars = 0;
+    for (;;) {
+        if (tokenizer_at_end(tokenizer) || tokenizer_peek(tokenizer) == '\n') {
+            ERR_NO_VARARG(tokenizer, "unterminated character literal");
+            return TOKEN_UNKNOWN;
         }
-    } break;
-    case ';': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_SEMICOLON;
-        token.lexeme = SV(";");
-        tokenizer->column++;
-    } break;
-    case ',': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_COMMA;
-        token.lexeme = SV(",");
-        tokenizer->column++;
-    } break;
-    case '.': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_DOT;
-        token.lexeme = SV(".");
-        tokenizer->column++;
-        if (tokenizer_peek(tokenizer) == '.') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_DOT_DOT;
-            token.lexeme = SV("..");
-            tokenizer->column++;
+        char c = tokenizer_advance(tokenizer);
+        if (c == '\'') {
+            break;
         }
-    } break;
-    case '"': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_STRING_LIT;
-        tokenizer->column++;
-        char *start = vec_get(&tokenizer->file->contents, tokenizer->pos);
-        usize len = 0;
-        for (;;) {
-            if (tokenizer->pos >= vec_len(&tokenizer->file->contents)) {
-                token.kind = TOKEN_UNKNOWN;
-                ERR_NO_VARARG(tokenizer, "unterminated string literal");
-                return token;
-            }
-            char c = tokenizer_advance(tokenizer);
-            if (c == '"') {
-                tokenizer->column++;
-                break;
-            }
-            if (c == '\n') {
-                token.kind = TOKEN_UNKNOWN;
-                ERR_NO_VARARG(tokenizer, "unterminated string literal");
-                return token;
-            }
-            len++;
-            tokenizer->column++;
+
+        // An escape is one character, as is every UTF-8 lead byte.
+        if (c == '\\') {
+            tokenizer_lex_escape(tokenizer);
+            chars++;
+        } else if (((u8)c & 0xC0) != 0x80) {
+            chars++;
         }
-        token.lexeme = SV_LEN(start, len);
-    } break;
-    case '\'': {
-        tokenizer_advance(tokenizer);
-        token.kind = TOKEN_CHAR_LIT;
-        tokenizer->column++;
-        char *start = vec_get(&tokenizer->file->contents, tokenizer->pos);
-        bool is_escaped = false;
-        for (;;) {
-            if (tokenizer->pos >= vec_len(&tokenizer->file->contents)) {
-                token.kind = TOKEN_UNKNOWN;
-                ERR_NO_VARARG(tokenizer, "unterminated character literal");
-                return token;
-            }
-            char c = tokenizer_advance(tokenizer);
-            if (c == '\'') {
-                tokenizer->column++;
-                break;
-            }
-            if (c == '\n') {
-                token.kind = TOKEN_UNKNOWN;
-                ERR_NO_VARARG(tokenizer, "unterminated character literal");
-                return token;
-            }
+    }
+    if (chars != 1) {
+        ERR_NO_VARARG(tokenizer,
+                      "character literal must contain exactly one character");
+        return TOKEN_UNKNOWN;
+    }
 
-            if (c == '\\') {
-                char code = tokenizer_advance(tokenizer);
-                tokenizer->column++;
-
-                switch (code) {
-                case 'n':
-                case 't':
-                case 'r':
-                case '\\':
-                case '\'':
-                case '"':
-                case '0':
-                    is_escaped = true;
-                    break;
-                default:
-                    ERR(tokenizer, "unknown escape sequence '\\%c'", code);
-                    break;
-                }
-            }
+    if (tokenizer->literal_pool != NULL)
+        tokenizer->literal = literal_pool_char(
+            tokenizer->literal_pool, tokenizer_literal_body(tokenizer));
+    return TOKEN_CHAR_LIT;
+}
+
+// Lexes one token starting at the next non-trivia byte. On return the token
+// occupies [token_start, pos) and `loc`, if given, is where it starts.
+static TokenKind tokenizer_lex(Tokenizer *tokenizer, Location *loc) {
+    tokenizer->literal = LITERAL_NONE;
+    tokenizer_skip_trivia(tokenizer);
+    if (tokenizer_at_end(tokenizer)) {
+        return TOKEN_EOF;
+    }
+
+    if (loc != NULL)
+        *loc = tokenizer_location(tokenizer);
+
+    switch (lexer.classes[(u8)tokenizer_peek(tokenizer)]) {
+    case CHAR_IDENT:
+        return tokenizer_lex_ident(tokenizer);
+    case CHAR_DIGIT:
+        return tokenizer_lex_number(tokenizer);
+    case CHAR_QUOTE:
+        return tokenizer_lex_string(tokenizer);
+    case CHAR_APOSTROPHE:
+        return tokenizer_lex_char(tokenizer);
+    case CHAR_PUNCT:
+        return tokenizer_lex_punct(tokenizer);
+    default:
+        return tokenizer_lex_unknown(tokenizer);
+    }
+}
+
+// The lexeme is the token's text, minus the quotes of string and character
+// literals.
+static string token_text_to_lexeme(TokenKind kind, string text) {
+    if (kind == TOKEN_STRING_LIT || kind == TOKEN_CHAR_LIT)
+        return sv_substr(text, 1, text.size - 1);
+    return text;
+}
+
+Token tokenizer_next_token(Tokenizer *tokenizer) {
+    Token token = {0};
+    token.symbol = SYMBOL_NONE;
+    token.literal = LITERAL_NONE;
+    token.kind = tokenizer_lex(tokenizer, &token.loc);
+    if (token.kind == TOKEN_EOF) {
+        return token;
+    }
+
+    string text =
+        tokenizer_slice(tokenizer, tokenizer->token_start,
+                        tokenizer->pos - tokenizer->token_start);
+    token.lexeme = token_text_to_lexeme(token.kind, text);
+    if (token.kind == TOKEN_IDENT && tokenizer->interner != NULL)
+        token.symbol = intern(tokenizer->interner, text);
+    token.literal = tokenizer->literal;
+    return token;
+}
+
+// Sizes the arrays for roughly one token per six bytes of source; growing
+// past the estimate is amortized by vec_push.
+static void token_buffer_init(TokenBuffer *buffer, usize source_size) {
+    usize estimate = source_size / 6 + 16;
+    vec_init_tag(&buffer->kinds, MEM_TOKENIZER);
+    vec_init_tag(&buffer->starts, MEM_TOKENIZER);
+    vec_init_tag(&buffer->lengths, MEM_TOKENIZER);
+    vec_init_tag(&buffer->symbols, MEM_TOKENIZER);
+    vec_init_tag(&buffer->literals, MEM_TOKENIZER);
+    vec_reserve(&buffer->kinds, estimate);
+    vec_reserve(&buffer->starts, estimate);
+    vec_reserve(&buffer->lengths, estimate);
+    vec_reserve(&buffer->symbols, estimate);
+    vec_reserve(&buffer->literals, estimate);
+    vec_init_tag(&buffer->errors, MEM_TOKENIZER);
+    vec_init_tag(&buffer->error_tokens, MEM_TOKENIZER);
+    arena_init(&buffer->messages, MEM_TOKENIZER);
+    buffer->interner = NULL;
+    buffer->literal_pool = NULL;
+}
+
+static void token_buffer_push(TokenBuffer *buffer, TokenKind kind,
+                              usize start, usize end, Symbol symbol,
+                              LiteralId literal) {
+    vec_push(&buffer->kinds, kind);
+    vec_push(&buffer->starts, (u32)start);
+    vec_push(&buffer->lengths, (u32)(end - start));
+    vec_push(&buffer->symbols, symbol);
+    vec_push(&buffer->literals, literal);
+}
+
+static void token_buffer_pop(TokenBuffer *buffer) {
+    buffer->kinds.size--;
+    buffer->starts.size--;
+    buffer->lengths.size--;
+    buffer->symbols.size--;
+    buffer->literals.size--;
+}
+
+// Records an error raised in token `index`, copying its message out of
+// whichever tokenizer or buffer it came from.
+static void token_buffer_add_error(TokenBuffer *buffer, TokenizerError err,
+                                   usize index) {
+    err.message = arena_strdup(&buffer->messages, err.message);
+    vec_push(&buffer->errors, err);
+    vec_push(&buffer->error_tokens, (u32)index);
+}
+
+static inline usize token_buffer_end(TokenBuffer *buffer, usize index) {
+    return *vec_get(&buffer->starts, index) + *vec_get(&buffer->lengths, index);
+}
+
+// Lexes one token into `out`, moving the errors it raised along with it.
+static TokenKind tokenizer_lex_into(Tokenizer *tokenizer, TokenBuffer *out) {
+    TokenKind kind = tokenizer_lex(tokenizer, NULL);
+    for (usize i = 0; i < vec_len(&tokenizer->errors); i++)
+        token_buffer_add_error(out, *vec_get(&tokenizer->errors, i),
+                               vec_len(&out->kinds));
+    tokenizer->errors.size = 0;
+
+    Symbol symbol = SYMBOL_NONE;
+    if (kind == TOKEN_IDENT && tokenizer->interner != NULL) {
+        string text = tokenizer_slice(tokenizer, tokenizer->token_start,
+                                      tokenizer->pos - tokenizer->token_start);
+        symbol = intern(tokenizer->interner, text);
+    }
+
+    token_buffer_push(out, kind, tokenizer->token_start, tokenizer->pos,
+                      symbol, tokenizer->literal);
+    return kind;
+}
+
+TokenBuffer tokenizer_tokenize(File *file, Interner *interner,
+                               LiteralPool *literals) {
+    ASSERT(file->backing != FILE_BACKING_STREAM,
+           "cannot batch-tokenize streamed file '" SV_FMT "'",
+           SV_ARG(file->path));
+    ASSERT(vec_len(&file->contents) < UINT32_MAX,
+           "file '" SV_FMT "' is too large", SV_ARG(file->path));
+
+    TokenBuffer buffer;
+    token_buffer_init(&buffer, vec_len(&file->contents));
+    buffer.interner = interner;
+    buffer.literal_pool = literals;
+
+    Tokenizer *tokenizer = tokenizer_new(file);
+    tokenizer->interner = interner;
+    tokenizer->literal_pool = literals;
+    while (tokenizer_lex_into(tokenizer, &buffer) != TOKEN_EOF)
+        ;
+    tokenizer_free(tokenizer);
+    return buffer;
+}
+
+typedef struct {
+    File *file;
+    usize start, end;
+
+    // Tokens whose lexing began in [start, end), with symbols and literals
+    // in tables local to the chunk.
+    TokenBuffer tokens;
+    Interner symbols;
+    LiteralPool literals;
+    bool intern, decode;
+
+    // Where the worker stopped, which may be past `end` when the last token
+    // straddles the boundary.
+    usize stop;
+} LexChunk;
+
+static void tokenizer_lex_chunk(rawptr arg) {
+    LexChunk *chunk = arg;
+    token_buffer_init(&chunk->tokens, chunk->end - chunk->start);
+
+    Tokenizer *tokenizer = tokenizer_new(chunk->file);
+    tokenizer->pos = chunk->start;
+    if (chunk->intern) {
+        interner_init(&chunk->symbols);
+        chunk->tokens.interner = &chunk->symbols;
+        tokenizer->interner = &chunk->symbols;
+    }
+    if (chunk->decode) {
+        literal_pool_init(&chunk->literals);
+        chunk->tokens.literal_pool = &chunk->literals;
+        tokenizer->literal_pool = &chunk->literals;
+    }
+    while (tokenizer->pos < chunk->end) {
+        if (tokenizer_lex_into(tokenizer, &chunk->tokens) == TOKEN_EOF) {
+            token_buffer_pop(&chunk->tokens);
+            break;
         }
-        char *end = vec_get(&tokenizer->file->contents, tokenizer->pos - 1);
-        if (end - start != 1 && !is_escaped) {
-            token.kind = TOKEN_UNKNOWN;
-            ERR_NO_VARARG(
-                tokenizer,
-                "character literal must contain exactly one character");
-            return token;
+    }
+    chunk->stop = tokenizer->pos;
+    tokenizer_free(tokenizer);
+}
+
+TokenBuffer tokenizer_tokenize_parallel(File *file, usize threads,
+                                        Interner *interner,
+                                        LiteralPool *literals) {
+    string source = file_span(file);
+    if (threads > source.size / TOKENIZER_PARALLEL_MIN_CHUNK)
+        threads = source.size / TOKENIZER_PARALLEL_MIN_CHUNK;
+    if (threads <= 1)
+        return tokenizer_tokenize(file, interner, literals);
+
+    ASSERT(source.size < UINT32_MAX, "file '" SV_FMT "' is too large",
+           SV_ARG(file->path));
+
+    // The workers share the lexer tables, so build them up front.
+    lexer_init();
+
+    // Chunks start right after a newline, where no token can be in progress
+    // except a straddling one, which the merge below repairs.
+    LexChunk *chunks = malloc(threads * sizeof(LexChunk));
+    usize count = 0;
+    for (usize start = 0; start < source.size && count < threads; count++) {
+        usize end = source.size;
+        if (count + 1 < threads) {
+            end = source.size / threads * (count + 1);
+            if (end < start)
+                end = start;
+            const char *newline =
+                memchr(source.data + end, '\n', source.size - end);
+            end = newline ? (usize)(newline - source.data) + 1 : source.size;
         }
-        token.lexeme = SV_LEN(start, is_escaped ? end - start : 1);
-    } break;
-    default: {
-        if (isalpha(c) || c == '_') {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_IDENT;
-            tokenizer->column++;
-            char *start =
-                vec_get(&tokenizer->file->contents, tokenizer->pos - 1);
-            usize len = 1;
+        chunks[count].file = file;
+        chunks[count].start = start;
+        chunks[count].end = end;
+        chunks[count].intern = interner != NULL;
+        chunks[count].decode = literals != NULL;
+        start = end;
+    }
+
+    Thread **workers = malloc(count * sizeof(Thread *));
+    for (usize i = 1; i < count; i++)
+        workers[i] = thread_spawn(tokenizer_lex_chunk, &chunks[i]);
+    tokenizer_lex_chunk(&chunks[0]);
+    for (usize i = 1; i < count; i++)
+        thread_join(workers[i]);
+    free(workers);
+
+    // Stitch the chunks together in order. `truth` is where the tokens
+    // accepted so far end. A chunk's tokens are valid from the first one
+    // lexed after a position where the true stream also had a token
+    // boundary; until then the sequential tokenizer relexes from `truth`.
+    TokenBuffer out;
+    token_buffer_init(&out, source.size);
+    out.interner = interner;
+    out.literal_pool = literals;
+    Tokenizer *relexer = tokenizer_new(file);
+    relexer->interner = interner;
+    relexer->literal_pool = literals;
+    vec(Symbol) remap;
+    vec_init_tag(&remap, MEM_TOKENIZER);
+    vec(LiteralId) literal_remap;
+    vec_init_tag(&literal_remap, MEM_TOKENIZER);
+    usize truth = 0;
+    bool at_eof = false;
+
+    for (usize c = 0; c < count && !at_eof; c++) {
+        LexChunk *chunk = &chunks[c];
+        TokenBuffer *tokens = &chunk->tokens;
+        usize token_count = vec_len(&tokens->kinds);
+        usize first = 0;
+
+        if (truth != chunk->start) {
+            relexer->pos = truth;
+            usize j = 0;
             for (;;) {
-                if (tokenizer->pos >= vec_len(&tokenizer->file->contents)) {
+                while (j < token_count &&
+                       token_buffer_end(tokens, j) < relexer->pos)
+                    j++;
+                if (j < token_count &&
+                    token_buffer_end(tokens, j) == relexer->pos) {
+                    first = j + 1;
                     break;
                 }
-                char c = tokenizer_peek(tokenizer);
-                if (!isalnum(c) && c != '_') {
+                if (j == token_count && relexer->pos >= chunk->stop) {
+                    first = token_count;
                     break;
                 }
-                tokenizer_advance(tokenizer);
-                len++;
-                tokenizer->column++;
-            }
-            token.lexeme = SV_LEN(start, len);
-            if (sv_eq_cstr(token.lexeme, "fn"))
-                token.kind = TOKEN_KW_FN;
-            else if (sv_eq_cstr(token.lexeme, "struct"))
-                token.kind = TOKEN_KW_STRUCT;
-            else if (sv_eq_cstr(token.lexeme, "return"))
-                token.kind = TOKEN_KW_RETURN;
-            else if (sv_eq_cstr(token.lexeme, "this"))
-                token.kind = TOKEN_KW_THIS;
-            else if (sv_eq_cstr(token.lexeme, "if"))
-                token.kind = TOKEN_KW_IF;
-            else if (sv_eq_cstr(token.lexeme, "else"))
-                token.kind = TOKEN_KW_ELSE;
-            else if (sv_eq_cstr(token.lexeme, "let"))
-                token.kind = TOKEN_KW_LET;
-            else if (sv_eq_cstr(token.lexeme, "for"))
-                token.kind = TOKEN_KW_FOR;
-            else if (sv_eq_cstr(token.lexeme, "in"))
-                token.kind = TOKEN_KW_IN;
-            else if (sv_eq_cstr(token.lexeme, "true"))
-                token.kind = TOKEN_KW_TRUE;
-            else if (sv_eq_cstr(token.lexeme, "false"))
-                token.kind = TOKEN_KW_FALSE;
-            else if (sv_eq_cstr(token.lexeme, "try"))
-                token.kind = TOKEN_KW_TRY;
-            else if (sv_eq_cstr(token.lexeme, "throw"))
-                token.kind = TOKEN_KW_THROW;
-            else if (sv_eq_cstr(token.lexeme, "as"))
-                token.kind = TOKEN_KW_AS;
-        } else if (isdigit(c)) {
-            tokenizer_advance(tokenizer);
-            token.kind = TOKEN_INT_LIT;
-            tokenizer->column++;
-            char *start =
-                vec_get(&tokenizer->file->contents, tokenizer->pos - 1);
-            usize len = 1;
-            for (;;) {
-                if (tokenizer->pos >= vec_len(&tokenizer->file->contents)) {
-                    break;
-                }
-                char c = tokenizer_peek(tokenizer);
-                if (!isdigit(c)) {
+                if (tokenizer_lex_into(relexer, &out) == TOKEN_EOF) {
+                    token_buffer_pop(&out);
+                    at_eof = true;
                     break;
                 }
-                tokenizer_advance(tokenizer);
-                len++;
-                tokenizer->column++;
             }
-            token.lexeme = SV_LEN(start, len);
-            if (tokenizer_peek(tokenizer) == '.' &&
-                isdigit(tokenizer_peek_next(tokenizer))) {
-                tokenizer_advance(tokenizer);
-                token.kind = TOKEN_FLOAT_LIT;
-                token.lexeme = sv_concat(token.lexeme, SV("."));
-                tokenizer->column++;
-                char *start =
-                    vec_get(&tokenizer->file->contents, tokenizer->pos - 1);
-                usize len = 1;
-                for (;;) {
-                    if (tokenizer->pos >= vec_len(&tokenizer->file->contents)) {
-                        break;
-                    }
-                    char c = tokenizer_peek(tokenizer);
-                    if (!isdigit(c)) {
-                        break;
-                    }
-                    tokenizer_advance(tokenizer);
-                    len++;
-                    tokenizer->column++;
+            truth = relexer->pos;
+        }
+
+        if (!at_eof && first < token_count) {
+            usize base = vec_len(&out.kinds) - first;
+            for (usize i = 0; i < vec_len(&tokens->errors); i++) {
+                usize index = *vec_get(&tokens->error_tokens, i);
+                if (index < first)
+                    continue;
+                token_buffer_add_error(&out, *vec_get(&tokens->errors, i),
+                                       base + index);
+            }
+            // Local symbols and literals are mapped to global ones the
+            // first time they are seen, so each distinct one is added once
+            // per chunk.
+            if (interner != NULL) {
+                remap.size = 0;
+                for (usize i = 0; i < interner_len(&chunk->symbols); i++)
+                    vec_push(&remap, SYMBOL_NONE);
+            }
+            if (literals != NULL) {
+                literal_remap.size = 0;
+                for (usize i = 0; i < literal_pool_len(&chunk->literals); i++)
+                    vec_push(&literal_remap, LITERAL_NONE);
+            }
+            for (usize i = first; i < token_count; i++) {
+                Symbol symbol = *vec_get(&tokens->symbols, i);
+                if (symbol != SYMBOL_NONE) {
+                    Symbol *global = vec_get(&remap, symbol);
+                    if (*global == SYMBOL_NONE)
+                        *global = intern(interner,
+                                         interner_get(&chunk->symbols, symbol));
+                    symbol = *global;
                 }
-                token.lexeme = sv_concat(token.lexeme, SV_LEN(start, len));
+                LiteralId literal = *vec_get(&tokens->literals, i);
+                if (literal != LITERAL_NONE) {
+                    LiteralId *global = vec_get(&literal_remap, literal);
+                    if (*global == LITERAL_NONE)
+                        *global = literal_pool_add(
+                            literals,
+                            *literal_pool_get(&chunk->literals, literal));
+                    literal = *global;
+                }
+                token_buffer_push(&out, *vec_get(&tokens->kinds, i),
+                                  *vec_get(&tokens->starts, i),
+                                  token_buffer_end(tokens, i), symbol,
+                                  literal);
             }
-        } else {
-            token.kind = TOKEN_UNKNOWN;
-            ERR(tokenizer, "unexpected character '%c'", c);
+            truth = chunk->stop;
         }
-    } break;
+
+        token_buffer_free(tokens);
+        if (interner != NULL)
+            interner_free(&chunk->symbols);
+        if (literals != NULL)
+            literal_pool_free(&chunk->literals);
     }
 
-    return token;
-}
\ No newline at end of file
+    // Finish whatever the last chunk left over, normally just EOF.
+    relexer->pos = truth;
+    if (at_eof)
+        token_buffer_push(&out, TOKEN_EOF, source.size, source.size,
+                          SYMBOL_NONE, LITERAL_NONE);
+    else
+        while (tokenizer_lex_into(relexer, &out) != TOKEN_EOF)
+            ;
+
+    tokenizer_free(relexer);
+    vec_free(&remap);
+    vec_free(&literal_remap);
+    free(chunks);
+    return out;
+}
+
+void token_buffer_rebase(TokenBuffer *buffer, Interner *interner,
+                         LiteralPool *literals) {
+    // Local ids were handed out in order of first use, so adding them in id
+    // order gives the global tables the same order as a sequential run.
+    if (buffer->interner != NULL) {
+        vec(Symbol) remap;
+        vec_init_tag(&remap, MEM_TOKENIZER);
+        for (usize i = 0; i < interner_len(buffer->interner); i++)
+            vec_push(&remap,
+                     intern(interner, interner_get(buffer->interner, i)));
+        for (usize i = 0; i < vec_len(&buffer->symbols); i++) {
+            Symbol *symbol = vec_get(&buffer->symbols, i);
+            if (*symbol != SYMBOL_NONE)
+                *symbol = *vec_get(&remap, *symbol);
+        }
+        vec_free(&remap);
+        buffer->interner = interner;
+    }
+    if (buffer->literal_pool != NULL) {
+        vec(LiteralId) remap;
+        vec_init_tag(&remap, MEM_TOKENIZER);
+        for (usize i = 0; i < literal_pool_len(buffer->literal_pool); i++) {
+            Literal literal = *literal_pool_get(buffer->literal_pool, i);
+            vec_push(&remap, literal_pool_add(literals, literal));
+        }
+        for (usize i = 0; i < vec_len(&buffer->literals); i++) {
+            LiteralId *literal = vec_get(&buffer->literals, i);
+            if (*literal != LITERAL_NONE)
+                *literal = *vec_get(&remap, *literal);
+        }
+        vec_free(&remap);
+        buffer->literal_pool = literals;
+    }
+}
+
+void token_buffer_free(TokenBuffer *buffer) {
+    vec_free(&buffer->kinds);
+    vec_free(&buffer->starts);
+    vec_free(&buffer->lengths);
+    vec_free(&buffer->symbols);
+    vec_free(&buffer->literals);
+    vec_free(&buffer->errors);
+    vec_free(&buffer->error_tokens);
+    arena_free(&buffer->messages);
+}
+
+void tokenizer_retokenize(TokenBuffer *buffer, File *file, TextEdit edit) {
+    lexer_init();
+
+    usize edit_end = edit.offset + edit.deleted;
+    usize inserted_end = edit.offset + edit.inserted.size;
+    ASSERT(vec_len(&file->contents) - edit.deleted + edit.inserted.size <
+               UINT32_MAX,
+           "file '" SV_FMT "' is too large", SV_ARG(file->path));
+
+    // Tokens that end at least `lookahead` bytes before the edit were lexed
+    // without reading it, and since the lexer carries no state from one
+    // token to the next they are kept as they are.
+    usize count = vec_len(&buffer->kinds);
+    usize lo = 0, hi = count - 1;
+    while (lo < hi) {
+        usize mid = lo + (hi - lo) / 2;
+        if (token_buffer_end(buffer, mid) + lexer.lookahead <= edit.offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    usize restart = lo;
+    usize pos = restart ? token_buffer_end(buffer, restart - 1) : 0;
+
+    file_edit(file, edit);
+    isize delta = (isize)edit.inserted.size - (isize)edit.deleted;
+
+    // Relex until a new token ends where an old token past the edit ended;
+    // from there on both streams are the same. `synced` is the last old
+    // token replaced, which is the EOF token when the relex reached the end.
+    Tokenizer *tokenizer = tokenizer_new(file);
+    tokenizer->interner = buffer->interner;
+    tokenizer->literal_pool = buffer->literal_pool;
+    tokenizer->pos = pos;
+
+    TokenBuffer fresh;
+    token_buffer_init(&fresh, 0);
+    usize synced = restart;
+    for (;;) {
+        if (tokenizer_lex_into(tokenizer, &fresh) == TOKEN_EOF) {
+            synced = count - 1;
+            break;
+        }
+        if (tokenizer->pos < inserted_end)
+            continue;
+        while (synced < count - 1 &&
+               (token_buffer_end(buffer, synced) < edit_end ||
+                (isize)token_buffer_end(buffer, synced) + delta <
+                    (isize)tokenizer->pos))
+            synced++;
+        if (synced < count - 1 &&
+            (isize)token_buffer_end(buffer, synced) + delta ==
+                (isize)tokenizer->pos)
+            break;
+    }
+
+    tokenizer_free(tokenizer);
+
+    usize removed = synced - restart + 1;
+    usize added = vec_len(&fresh.kinds);
+    vec_splice(&buffer->kinds, restart, removed, fresh.kinds.data, added);
+    vec_splice(&buffer->starts, restart, removed, fresh.starts.data, added);
+    vec_splice(&buffer->lengths, restart, removed, fresh.lengths.data, added);
+    vec_splice(&buffer->symbols, restart, removed, fresh.symbols.data, added);
+    vec_splice(&buffer->literals, restart, removed, fresh.literals.data,
+               added);
+    if (delta != 0)
+        for (usize i = restart + added; i < vec_len(&buffer->starts); i++)
+            *vec_get(&buffer->starts, i) += (u32)delta;
+
+    lo = 0, hi = vec_len(&buffer->errors);
+    while (lo < hi) {
+        usize mid = lo + (hi - lo) / 2;
+        if (*vec_get(&buffer->error_tokens, mid) < restart)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    usize errors_lo = lo;
+    usize errors_hi = errors_lo;
+    while (errors_hi < vec_len(&buffer->errors) &&
+           *vec_get(&buffer->error_tokens, errors_hi) <= synced)
+        errors_hi++;
+
+    for (usize i = 0; i < vec_len(&fresh.errors); i++) {
+        TokenizerError *err = vec_get(&fresh.errors, i);
+        err->message = arena_strdup(&buffer->messages, err->message);
+        *vec_get(&fresh.error_tokens, i) += (u32)restart;
+    }
+    usize errors_added = vec_len(&fresh.errors);
+    vec_splice(&buffer->errors, errors_lo, errors_hi - errors_lo,
+               fresh.errors.data, errors_added);
+    vec_splice(&buffer->error_tokens, errors_lo, errors_hi - errors_lo,
+               fresh.error_tokens.data, errors_added);
+    for (usize i = errors_lo + errors_added; i < vec_len(&buffer->errors);
+         i++) {
+        vec_get(&buffer->errors, i)->loc.offset += (u32)delta;
+        *vec_get(&buffer->error_tokens, i) += (u32)(added - removed);
+    }
+
+    token_buffer_free(&fresh);
+}
+
+string token_buffer_lexeme(TokenBuffer *buffer, File *file, usize index) {
+    string text = SV_LEN(file->contents.data + *vec_get(&buffer->starts, index),
+                         *vec_get(&buffer->lengths, index));
+    return token_text_to_lexeme(*vec_get(&buffer->kinds, index), text);
+}
@@ -1,6 +1,7 @@
 #ifndef _CYCLONE_TOKENIZER_H
 #define _CYCLONE_TOKENIZER_H
 
+#include "arena.h"
 #include "common.h"
 #include "file.h"
 #include "location.h"
@@ -13,30 +14,111 @@ typedef struct {
 } TokenizerError;
 #define ERR(t, msg, ...)                                                       \
     do {                                                                       \
-        string message = sv_from_fmt(msg, ##__VA_ARGS__);                      \
+        string message = sv_from_fmt(&t->messages, msg, ##__VA_ARGS__);        \
         TokenizerError err =                                                   \
-            ((TokenizerError){message, LOC(t->file->id, t->line, t->column)}); \
-        vec_push(&t->errors, err);                                             \
+            ((TokenizerError){message, LOC(t->file->id, (u32)t->pos)});        \
+        smallvec_push(&t->errors, err);                                        \
     } while (0)
 #define ERR_NO_VARARG(t, msg)                                                  \
     do {                                                                       \
         string message = SV(msg);                                              \
         TokenizerError err =                                                   \
-            ((TokenizerError){message, LOC(t->file->id, t->line, t->column)}); \
-        vec_push(&t->errors, err);                                             \
+            ((TokenizerError){message, LOC(t->file->id, (u32)t->pos)});        \
+        smallvec_push(&t->errors, err);                                        \
     } while (0)
 
+#define TOKENIZER_CHUNK_SIZE (64 * 1024)
+
 typedef struct {
     File *file;
     usize pos;
-    u32 line, column;
 
-    vec(TokenizerError) errors;
+    // Bytes [buffer_start, buffer_start + buffer_len) of the source are
+    // resident at `buffer`. In memory this is the whole file; when streaming
+    // it is a window that keeps the current token and one chunk of lookahead.
+    const char *buffer;
+    usize buffer_start, buffer_len;
+    usize token_start;
+    vec(char) window;
+    bool at_eof;
+
+    // Drained after every token when lexing into a TokenBuffer, so it
+    // rarely outgrows its inline storage.
+    smallvec(TokenizerError, 4) errors;
+    // Error messages are formatted into here and live as long as the
+    // tokenizer.
+    Arena messages;
+
+    // Identifiers are interned here when set.
+    Interner *interner;
+    // Literals are decoded into here when set; `literal` is the last one.
+    LiteralPool *literal_pool;
+    LiteralId literal;
 } Tokenizer;
 
+// Builds the lexer's tables. `tokenizer_new` does this on first use, but
+// threads that lex concurrently need it done beforehand.
+void tokenizer_init(void);
+// Streams the source when `file` was opened with `file_open_stream`. In that
+// mode a token's lexeme is only valid until the next `tokenizer_next_token`,
+// though an identifier's interned text stays valid.
 Tokenizer *tokenizer_new(File *file);
 void tokenizer_free(Tokenizer *tokenizer);
 
+// A whole file's tokens as parallel arrays, terminated by a TOKEN_EOF entry.
+// `starts` and `lengths` cover the token's full text (including the quotes
+// of string and character literals), so lexemes are recovered from the
+// source on demand instead of being stored. `error_tokens` holds the index
+// of the token each error was raised in. `symbols` holds each identifier's
+// symbol in `interner`, or SYMBOL_NONE when there is no interner, and
+// `literals` each literal's id in `literal_pool` in the same way. Error
+// messages are copied into `messages`.
+typedef struct {
+    vec(TokenKind) kinds;
+    vec(u32) starts;
+    vec(u32) lengths;
+    vec(Symbol) symbols;
+    vec(LiteralId) literals;
+    vec(TokenizerError) errors;
+    vec(u32) error_tokens;
+    Arena messages;
+    Interner *interner;
+    LiteralPool *literal_pool;
+} TokenBuffer;
+
+#define TOKENIZER_PARALLEL_MIN_CHUNK (256 * 1024)
+
+// `interner` and `literals` may be NULL when identifiers need not be
+// interned or literals decoded.
+TokenBuffer tokenizer_tokenize(File *file, Interner *interner,
+                               LiteralPool *literals);
+// Splits the file at newlines into up to `threads` chunks of at least
+// TOKENIZER_PARALLEL_MIN_CHUNK bytes and lexes them concurrently. The result
+// is identical to `tokenizer_tokenize`. Each worker interns into a table and
+// a literal pool of its own, which the merge maps onto `interner` and
+// `literals`.
+TokenBuffer tokenizer_tokenize_parallel(File *file, usize threads,
+                                        Interner *interner,
+                                        LiteralPool *literals);
+// Applies `edit` to the file and brings `buffer` up to date with it. Only
+// the tokens from just before the edit up to where the new stream lines up
+// with the old one are relexed; the rest are shifted in place.
+void tokenizer_retokenize(TokenBuffer *buffer, File *file, TextEdit edit);
+// Moves the buffer's symbols and literals into `interner` and `literals`,
+// which become its tables. The old ones are left for the caller to free.
+void token_buffer_rebase(TokenBuffer *buffer, Interner *interner,
+                         LiteralPool *literals);
+void token_buffer_free(TokenBuffer *buffer);
+string token_buffer_lexeme(TokenBuffer *buffer, File *file, usize index);
+
+// Kind of the token `k` places after `index`; past the end this is EOF.
+static inline TokenKind token_buffer_peek(TokenBuffer *buffer, usize index,
+                                          usize k) {
+    if (index + k >= vec_len(&buffer->kinds))
+        return TOKEN_EOF;
+    return *vec_get(&buffer->kinds, index + k);
+}
+
 char tokenizer_advance(Tokenizer *tokenizer);
 char tokenizer_peek(Tokenizer *tokenizer);
 char tokenizer_peek_next(Tokenizer *tokenizer);
@@ -1,21 +1,401 @@
-#include <assert.h>
 #include <stdlib.h>
 
 #include "utf8.h"
 
-UTF8String utf8_new(const char *str) {
+#if defined(__GNUC__) && defined(__SSE2__)
+#define UTF8_X86
+#include <immintrin.h>
+#endif
+
+// Table 3-7 of the Unicode standard as a state machine: the lead byte picks
+// how many continuation bytes follow and, for E0, ED, F0 and F4, a narrower
+// range for the first of them.
+static inline Utf8State utf8_step(Utf8State state, u8 c) {
+    switch (state) {
+    case UTF8_ACCEPT:
+        if (c < 0x80)
+            return UTF8_ACCEPT;
+        if (c < 0xC2)
+            return UTF8_REJECT;
+        if (c < 0xE0)
+            return UTF8_NEED1;
+        if (c == 0xE0)
+            return UTF8_AFTER_E0;
+        if (c == 0xED)
+            return UTF8_AFTER_ED;
+        if (c < 0xF0)
+            return UTF8_NEED2;
+        if (c == 0xF0)
+            return UTF8_AFTER_F0;
+        if (c < 0xF4)
+            return UTF8_NEED3;
+        if (c == 0xF4)
+            return UTF8_AFTER_F4;
+        return UTF8_REJECT;
+    case UTF8_NEED1:
+        return (c & 0xC0) == 0x80 ? UTF8_ACCEPT : UTF8_REJECT;
+    case UTF8_NEED2:
+        return (c & 0xC0) == 0x80 ? UTF8_NEED1 : UTF8_REJECT;
+    case UTF8_NEED3:
+        return (c & 0xC0) == 0x80 ? UTF8_NEED2 : UTF8_REJECT;
+    case UTF8_AFTER_E0:
+        return c >= 0xA0 && c <= 0xBF ? UTF8_NEED1 : UTF8_REJECT;
+    case UTF8_AFTER_ED:
+        return c >= 0x80 && c <= 0x9F ? UTF8_NEED1 : UTF8_REJECT;
+    case UTF8_AFTER_F0:
+        return c >= 0x90 && c <= 0xBF ? UTF8_NEED2 : UTF8_REJECT;
+    case UTF8_AFTER_F4:
+        return c >= 0x80 && c <= 0x8F ? UTF8_NEED2 : UTF8_REJECT;
+    default:
+        return UTF8_REJECT;
+    }
+}
+
+// Runs the state machine over `data`, skipping ASCII eight bytes at a time.
+// On failure returns where the offending sequence began (clamped to zero
+// when it began in an earlier piece), otherwise `len`.
+static usize utf8_validate_scalar(Utf8State *state, const char *data,
+                                  usize len) {
+    Utf8State s = *state;
+    usize start = 0;
+    usize i = 0;
+    while (i < len) {
+        if (s == UTF8_ACCEPT) {
+            for (; i + 8 <= len; i += 8) {
+                u64 word;
+                memcpy(&word, data + i, 8);
+                if (word & 0x8080808080808080ull)
+                    break;
+            }
+            if (i == len)
+                break;
+            start = i;
+        }
+        s = utf8_step(s, (u8)data[i++]);
+        if (s == UTF8_REJECT) {
+            *state = s;
+            return start;
+        }
+    }
+    *state = s;
+    return len;
+}
+
+// Exact offset of the first error at or after `from`, which must be a
+// codepoint boundary of a valid prefix.
+static usize utf8_validate_from(const char *data, usize len, usize from) {
+    Utf8State state = UTF8_ACCEPT;
+    usize bad = from + utf8_validate_scalar(&state, data + from, len - from);
+    if (bad < len || state == UTF8_ACCEPT)
+        return bad;
+
+    // Truncated at the end: report the lead byte of the last sequence.
+    usize lead = len;
+    while (lead > from && ((u8)data[lead - 1] & 0xC0) == 0x80)
+        lead--;
+    return lead > from ? lead - 1 : from;
+}
+
+static usize utf8_count_scalar(const char *data, usize len) {
+    usize n = 0;
+    for (usize i = 0; i < len; i++)
+        n += ((u8)data[i] & 0xC0) != 0x80;
+    return n;
+}
+
+static usize utf8_validate_fallback(const char *data, usize len) {
+    return utf8_validate_from(data, len, 0);
+}
+
+#ifdef UTF8_X86
+
+static usize utf8_count_sse2(const char *data, usize len) {
+    usize n = 0, i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(data + i));
+        // Continuation bytes are 0x80..0xBF, below -64 as signed bytes.
+        u32 cont =
+            (u32)_mm_movemask_epi8(_mm_cmplt_epi8(x, _mm_set1_epi8(-64)));
+        n += 16 - (usize)__builtin_popcount(cont);
+    }
+    return n + utf8_count_scalar(data + i, len - i);
+}
+
+#define AVX2 __attribute__((target("avx2")))
+
+// The bytes of `input` shifted `n` places later, with the last `n` bytes of
+// `prev` shifted in.
+#define AVX2_PREV(input, prev, n)                                              \
+    _mm256_alignr_epi8((input),                                                \
+                       _mm256_permute2x128_si256((prev), (input), 0x21),       \
+                       16 - (n))
+#define AVX2_TABLE(...) _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+
+// Error classes for a pair of adjacent bytes, after "Validating UTF-8 In
+// Less Than One Instruction Per Byte" (Keiser and Lemire). Each nibble
+// lookup yields the classes its half of the pair allows; a pair is bad when
+// all three lookups agree on some class.
+#define TOO_SHORT (1 << 0)  // lead byte not followed by a continuation
+#define TOO_LONG (1 << 1)   // continuation after ASCII
+#define OVERLONG_3 (1 << 2) // E0 80..9F
+#define TOO_LARGE (1 << 3)  // F4 90..BF, or F5..FF
+#define SURROGATE (1 << 4)  // ED A0..BF
+#define OVERLONG_2 (1 << 5) // C0 or C1
+#define TOO_LARGE_1000 (1 << 6)
+#define OVERLONG_4 (1 << 6) // F0 80..8F
+#define TWO_CONTS ((char)0x80) // continuation after continuation
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+AVX2 static inline __m256i avx2_utf8_errors(__m256i input, __m256i prev_input) {
+    const __m256i byte_1_high_table = AVX2_TABLE(
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TOO_LONG, TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+    const __m256i byte_1_low_table = AVX2_TABLE(
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2,
+        CARRY, CARRY, CARRY | TOO_LARGE, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000);
+    const __m256i byte_2_high_table = AVX2_TABLE(
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_SHORT, TOO_SHORT,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 |
+            OVERLONG_4,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, TOO_SHORT,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT);
+
+    __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i prev1 = AVX2_PREV(input, prev_input, 1);
+    __m256i byte_1_high = _mm256_shuffle_epi8(
+        byte_1_high_table,
+        _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+    __m256i byte_1_low =
+        _mm256_shuffle_epi8(byte_1_low_table, _mm256_and_si256(prev1, nibble));
+    __m256i byte_2_high = _mm256_shuffle_epi8(
+        byte_2_high_table,
+        _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+    __m256i special = _mm256_and_si256(
+        _mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    // Third and fourth bytes of a sequence are expected to be TWO_CONTS
+    // pairs; flip that bit where a three or four byte lead demands it.
+    __m256i prev2 = AVX2_PREV(input, prev_input, 2);
+    __m256i prev3 = AVX2_PREV(input, prev_input, 3);
+    __m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80));
+    __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0 - 0x80));
+    __m256i must23 = _mm256_and_si256(_mm256_or_si256(third, fourth),
+                                      _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must23, special);
+}
+
+#undef TOO_SHORT
+#undef TOO_LONG
+#undef OVERLONG_3
+#undef TOO_LARGE
+#undef SURROGATE
+#undef OVERLONG_2
+#undef TOO_LARGE_1000
+#undef OVERLONG_4
+#undef TWO_CONTS
+#undef CARRY
+
+// Non-zero where the block ends inside a sequence.
+AVX2 static inline __m256i avx2_utf8_incomplete(__m256i input) {
+    const __m256i max = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char)(0xF0 - 1),
+        (char)(0xE0 - 1), (char)(0xC0 - 1));
+    return _mm256_subs_epu8(input, max);
+}
+
+AVX2 static usize utf8_validate_avx2(const char *data, usize len) {
+    __m256i error = _mm256_setzero_si256();
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+
+    usize i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i input = _mm256_loadu_si256((const __m256i *)(data + i));
+        if (_mm256_movemask_epi8(input) == 0) {
+            error = _mm256_or_si256(error, prev_incomplete);
+        } else {
+            error = _mm256_or_si256(error, avx2_utf8_errors(input, prev_input));
+            prev_incomplete = avx2_utf8_incomplete(input);
+            prev_input = input;
+        }
+        if (!_mm256_testz_si256(error, error))
+            break;
+    }
+
+    if (_mm256_testz_si256(error, error)) {
+        if (i < len) {
+            // Zero padding reads as ASCII, so a sequence cut off by the end
+            // of the input shows up as TOO_SHORT.
+            char tail[32] = {0};
+            memcpy(tail, data + i, len - i);
+            __m256i input = _mm256_loadu_si256((const __m256i *)tail);
+            error = avx2_utf8_errors(input, prev_input);
+        } else {
+            error = prev_incomplete;
+        }
+        if (_mm256_testz_si256(error, error))
+            return len;
+    }
+
+    // The block that failed, or a sequence left incomplete by an earlier
+    // one, starts at most one block back; find the exact byte from there.
+    usize from = i >= 32 ? i - 32 : 0;
+    while (from > 0 && ((u8)data[from] & 0xC0) == 0x80)
+        from--;
+    return utf8_validate_from(data, len, from);
+}
+
+AVX2 static usize utf8_count_avx2(const char *data, usize len) {
+    usize n = 0, i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(data + i));
+        u32 cont = (u32)_mm256_movemask_epi8(
+            _mm256_cmpgt_epi8(_mm256_set1_epi8(-64), x));
+        n += 32 - (usize)__builtin_popcount(cont);
+    }
+    return n + utf8_count_sse2(data + i, len - i);
+}
+
+#endif // UTF8_X86
+
+static usize (*utf8_validate_impl)(const char *data, usize len);
+static usize (*utf8_count_impl)(const char *data, usize len);
+
+void utf8_init(void) {
+    if (utf8_validate_impl != NULL)
+        return;
+
+#ifdef UTF8_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        utf8_count_impl = utf8_count_avx2;
+        utf8_validate_impl = utf8_validate_avx2;
+        return;
+    }
+    utf8_count_impl = utf8_count_sse2;
+#else
+    utf8_count_impl = utf8_count_scalar;
+#endif
+    utf8_validate_impl = utf8_validate_fallback;
+}
+
+usize utf8_validate(const char *data, usize len) {
+    utf8_init();
+    return utf8_validate_impl(data, len);
+}
+
+usize utf8_validate_partial(Utf8State *state, const char *data, usize len) {
+    usize i = 0;
+    while (*state != UTF8_ACCEPT && *state != UTF8_REJECT && i < len)
+        *state = utf8_step(*state, (u8)data[i++]);
+    if (*state == UTF8_REJECT)
+        return 0;
+    if (i == len)
+        return len;
+
+    // Hand the bulk to the fast validator, up to the start of the last
+    // sequence, which may continue in the next piece.
+    usize end = len;
+    for (usize k = 1; k <= 4 && k <= len - i; k++) {
+        if (((u8)data[len - k] & 0xC0) != 0x80) {
+            end = len - k;
+            break;
+        }
+    }
+
+    usize bad = i + utf8_validate(data + i, end - i);
+    if (bad < end) {
+        *state = UTF8_REJECT;
+        return bad;
+    }
+    return end + utf8_validate_scalar(state, data + end, len - end);
+}
+
+usize utf8_count(const char *data, usize len) {
+    utf8_init();
+    return utf8_count_impl(data, len);
+}
+
+rune utf8_decode(const char *data, usize len, usize *size) {
+    Utf8State state = UTF8_ACCEPT;
+    rune r = 0;
+    for (usize i = 0; i < len && i < 4; i++) {
+        u8 c = (u8)data[i];
+        state = utf8_step(state, c);
+        if (state == UTF8_REJECT)
+            break;
+        if (i == 0)
+            r = c < 0x80 ? c : c < 0xE0 ? c & 0x1F : c < 0xF0 ? c & 0x0F
+                                                               : c & 0x07;
+        else
+            r = (r << 6) | (c & 0x3F);
+        if (state == UTF8_ACCEPT) {
+            *size = i + 1;
+            return r;
+        }
+    }
+    *size = 1;
+    return UTF8_REPLACEMENT;
+}
+
+usize utf8_encode(rune r, char out[4]) {
+    if (r < 0x80) {
+        out[0] = (char)r;
+        return 1;
+    }
+    if (r < 0x800) {
+        out[0] = (char)(0xC0 | (r >> 6));
+        out[1] = (char)(0x80 | (r & 0x3F));
+        return 2;
+    }
+    if ((r >= 0xD800 && r <= 0xDFFF) || r > 0x10FFFF)
+        r = UTF8_REPLACEMENT;
+    if (r < 0x10000) {
+        out[0] = (char)(0xE0 | (r >> 12));
+        out[1] = (char)(0x80 | ((r >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (r & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (r >> 18));
+    out[1] = (char)(0x80 | ((r >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((r >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (r & 0x3F));
+    return 4;
+}
+
+UTF8String utf8_view_to_owned(UTF8View view) {
     UTF8String s;
     s.len = 0;
-    while (str[s.len] != '\0') {
+    s.data = malloc(view.size * sizeof(rune));
+    usize pos = 0;
+    while (utf8_view_next(view, &pos, &s.data[s.len]))
         s.len++;
-    }
-    s.data = malloc(s.len * sizeof(rune));
-    for (usize i = 0; i < s.len; i++) {
-        s.data[i] = (rune)str[i];
-    }
     return s;
 }
 
+char *utf8_view_to_cstr(UTF8View view) {
+    char *cstr = malloc(view.size + 1);
+    memcpy(cstr, view.data, view.size);
+    cstr[view.size] = '\0';
+    return cstr;
+}
+
+UTF8String utf8_new(const char *str) {
+    return utf8_view_to_owned((UTF8View){str, strlen(str)});
+}
+
 void utf8_free(UTF8String *str) {
     free(str->data);
     str->data = NULL;
@@ -23,12 +403,10 @@ void utf8_free(UTF8String *str) {
 }
 
 const char *utf8_to_cstr(UTF8String s) {
-    char *cstr = malloc(s.len + 1);
-    for (usize i = 0; i < s.len; i++) {
-        rune c = s.data[i];
-        assert(c <= 127 && "UTF-8 string contains non-ASCII characters");
-        cstr[i] = (char)c;
-    }
-    cstr[s.len] = '\0';
+    char *cstr = malloc(s.len * 4 + 1);
+    usize len = 0;
+    for (usize i = 0; i < s.len; i++)
+        len += utf8_encode(s.data[i], cstr + len);
+    cstr[len] = '\0';
     return cstr;
 }
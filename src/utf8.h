@@ -3,15 +3,84 @@
 
 #include "common.h"
 
-typedef u8 rune;
+typedef u32 rune;
 typedef struct {
     rune *data;
     usize len;
 } UTF8String;
 
+#define UTF8_REPLACEMENT ((rune)0xFFFD)
+
+// Decoder state carried between pieces of a longer input.
+typedef u8 Utf8State;
+enum {
+    UTF8_ACCEPT, // at a codepoint boundary
+    UTF8_REJECT, // saw an invalid sequence
+    UTF8_NEED1,  // one more continuation byte
+    UTF8_NEED2,
+    UTF8_NEED3,
+    UTF8_AFTER_E0, // second byte must be A0..BF (no overlong forms)
+    UTF8_AFTER_ED, // second byte must be 80..9F (no surrogates)
+    UTF8_AFTER_F0, // second byte must be 90..BF (no overlong forms)
+    UTF8_AFTER_F4, // second byte must be 80..8F (nothing past U+10FFFF)
+};
+
+// Picks the implementations for this CPU. The functions below do it on
+// first use, but threads that validate concurrently need it done first.
+void utf8_init(void);
+
+// Returns the offset of the first byte of the first invalid or truncated
+// sequence, or `len` when the whole input is valid UTF-8.
+usize utf8_validate(const char *data, usize len);
+// Like `utf8_validate` for one piece of an input split at arbitrary
+// offsets; `state` starts as UTF8_ACCEPT and must end there.
+usize utf8_validate_partial(Utf8State *state, const char *data, usize len);
+// Number of codepoints in valid UTF-8.
+usize utf8_count(const char *data, usize len);
+
+// Decodes the codepoint at `data`, storing its length in `size`. Invalid
+// input decodes as U+FFFD with a size of one.
+rune utf8_decode(const char *data, usize len, usize *size);
+// Writes `r` to `out` and returns the number of bytes used (one to four).
+usize utf8_encode(rune r, char out[4]);
+
+// Borrowed UTF-8 text, such as a span of a File's contents or an interned
+// string. Nothing is copied or decoded up front: runes are decoded as the
+// view is iterated, and the bytes must outlive the view.
+typedef struct {
+    const char *data;
+    usize size;
+} UTF8View;
+#define UTF8_VIEW(s) ((UTF8View){(s).data, (s).size})
+
+// Decodes the rune at `*pos` into `out` and moves `*pos` past it. Returns
+// false at the end of the view.
+static inline bool utf8_view_next(UTF8View view, usize *pos, rune *out) {
+    if (*pos >= view.size)
+        return false;
+    u8 c = (u8)view.data[*pos];
+    if (c < 0x80) {
+        *out = c;
+        *pos += 1;
+        return true;
+    }
+    usize size;
+    *out = utf8_decode(view.data + *pos, view.size - *pos, &size);
+    *pos += size;
+    return true;
+}
+
+static inline usize utf8_view_len(UTF8View view) {
+    return utf8_count(view.data, view.size);
+}
+
+// The only copying conversions: each returns a malloc'd buffer the caller
+// owns.
+UTF8String utf8_view_to_owned(UTF8View view);
+char *utf8_view_to_cstr(UTF8View view);
+// Decodes the C string, replacing invalid sequences with U+FFFD.
 UTF8String utf8_new(const char *str);
 void utf8_free(UTF8String *str);
-
 const char *utf8_to_cstr(UTF8String s);
 
-#endif // _CYCLONE_UTF8_H_
\ No newline at end of file
+#endif // _CYCLONE_UTF8_H_
@@ -2,33 +2,72 @@
 #define _CYCLONE_VECTOR_H
 
 #include "common.h"
+#include "mem.h"
+
+// The capacity a vector gets on its first push.
+#define VEC_MIN_CAPACITY 8
 
 #define vec(T)                                                                 \
     struct {                                                                   \
         T *data;                                                               \
         usize size;                                                            \
         usize capacity;                                                        \
+        MemTag tag;                                                            \
     }
-#define vec_init(v)                                                            \
+#define vec_init(v) vec_init_tag(v, MEM_OTHER)
+// Charges the vector's memory to `tag`; see mem.h.
+#define vec_init_tag(v, t)                                                     \
     do {                                                                       \
         (v)->data = NULL;                                                      \
         (v)->size = 0;                                                         \
         (v)->capacity = 0;                                                     \
+        (v)->tag = (t);                                                        \
     } while (0)
 #define vec_free(v)                                                            \
     do {                                                                       \
-        free((v)->data);                                                       \
-        vec_init(v);                                                           \
+        mem_free((v)->tag, (v)->data, (v)->capacity * sizeof(*(v)->data));     \
+        (v)->data = NULL;                                                      \
+        (v)->size = 0;                                                         \
+        (v)->capacity = 0;                                                     \
     } while (0)
-#define vec_push(v, e)                                                         \
+// Room for at least `n` more elements, growing geometrically.
+#define vec_reserve(v, n)                                                      \
     do {                                                                       \
-        if ((v)->size == (v)->capacity) {                                      \
-            (v)->capacity = (v)->capacity ? (v)->capacity * 2 : 1;             \
-            (v)->data =                                                        \
-                realloc((v)->data, (v)->capacity * sizeof(*(v)->data));        \
+        usize _needed = (v)->size + (n);                                       \
+        if (_needed > (v)->capacity) {                                         \
+            usize _old = (v)->capacity * sizeof(*(v)->data);                   \
+            usize _capacity =                                                  \
+                (v)->capacity ? (v)->capacity * 2 : VEC_MIN_CAPACITY;          \
+            (v)->capacity = _capacity > _needed ? _capacity : _needed;         \
+            (v)->data = mem_realloc((v)->tag, (v)->data, _old,                 \
+                                    (v)->capacity * sizeof(*(v)->data));       \
         }                                                                      \
+    } while (0)
+#define vec_push(v, e)                                                         \
+    do {                                                                       \
+        vec_reserve(v, 1);                                                     \
         (v)->data[(v)->size++] = (e);                                          \
     } while (0)
+// Appends `n` elements from `src` with a single copy.
+#define vec_extend(v, src, n)                                                  \
+    do {                                                                       \
+        usize _n = (n);                                                        \
+        vec_reserve(v, _n);                                                    \
+        if (_n != 0)                                                           \
+            memcpy((v)->data + (v)->size, (src), _n * sizeof(*(v)->data));     \
+        (v)->size += _n;                                                       \
+    } while (0)
+// Sets the length to `n`; new elements are zeroed.
+#define vec_resize(v, n)                                                       \
+    do {                                                                       \
+        usize _n = (n);                                                        \
+        if (_n > (v)->size) {                                                  \
+            vec_reserve(v, _n - (v)->size);                                    \
+            memset((v)->data + (v)->size, 0,                                   \
+                   (_n - (v)->size) * sizeof(*(v)->data));                     \
+        }                                                                      \
+        (v)->size = _n;                                                        \
+    } while (0)
 #define vec_pop(v) ((v)->data[--(v)->size])
 #define vec_last(v) ((v)->data[(v)->size - 1])
 #define vec_get(v, i) (&((v)->data[(i)]))
@@ -37,12 +76,69 @@
         (v)->data[(i)] = (e);                                                  \
     } while (0)
 #define vec_len(v) ((v)->size)
+// Replaces the `removed` elements at `at` with `added` elements from `src`.
+#define vec_splice(v, at, removed, src, added)                                 \
+    do {                                                                       \
+        usize _at = (at), _removed = (removed), _added = (added);              \
+        usize _size = (v)->size - _removed + _added;                           \
+        if (_added > _removed)                                                 \
+            vec_reserve(v, _added - _removed);                                 \
+        if (_removed != _added)                                                \
+            memmove((v)->data + _at + _added, (v)->data + _at + _removed,      \
+                    ((v)->size - _at - _removed) * sizeof(*(v)->data));        \
+        if (_added != 0)                                                       \
+            memcpy((v)->data + _at, (src), _added * sizeof(*(v)->data));       \
+        (v)->size = _size;                                                     \
+    } while (0)
 
 #define vec_foreach(v, e)                                                      \
     for (usize _i = 0; _i < (v)->size && ((e) = (v)->data[_i], 1); _i++)
 
 #define vec_range(v, start, end) for (usize _i = (start); _i < (end); _i++)
 
+// A vector whose first N elements live inline, so short lists never touch
+// the heap. It shares vec's fields, so vec_get, vec_len, vec_pop and
+// vec_foreach work on it, but it must only grow through smallvec_push and
+// must not be copied once it has been initialized.
+#define smallvec(T, N)                                                         \
+    struct {                                                                   \
+        T *data;                                                               \
+        usize size;                                                            \
+        usize capacity;                                                        \
+        MemTag tag;                                                            \
+        T inline_data[N];                                                      \
+    }
+#define smallvec_init(v) smallvec_init_tag(v, MEM_OTHER)
+#define smallvec_init_tag(v, t)                                                \
+    do {                                                                       \
+        (v)->data = (v)->inline_data;                                          \
+        (v)->size = 0;                                                         \
+        (v)->capacity = sizeof((v)->inline_data) / sizeof(*(v)->data);         \
+        (v)->tag = (t);                                                        \
+    } while (0)
+#define smallvec_free(v)                                                       \
+    do {                                                                       \
+        if ((v)->data != (v)->inline_data)                                     \
+            mem_free((v)->tag, (v)->data,                                      \
+                     (v)->capacity * sizeof(*(v)->data));                      \
+        smallvec_init_tag(v, (v)->tag);                                        \
+    } while (0)
+#define smallvec_push(v, e)                                                    \
+    do {                                                                       \
+        if ((v)->size == (v)->capacity) {                                      \
+            usize _bytes = (v)->capacity * sizeof(*(v)->data);                 \
+            if ((v)->data == (v)->inline_data) {                               \
+                (v)->data = mem_alloc((v)->tag, _bytes * 2);                   \
+                memcpy((v)->data, (v)->inline_data, _bytes);                   \
+            } else {                                                           \
+                (v)->data =                                                    \
+                    mem_realloc((v)->tag, (v)->data, _bytes, _bytes * 2);      \
+            }                                                                  \
+            (v)->capacity *= 2;                                                \
+        }                                                                      \
+        (v)->data[(v)->size++] = (e);                                          \
+    } while (0)
+
 #define vec_to_string(v)                                                       \
     ((string){                                                                 \
         .data = (char *)(v)->data,                                             \
@@ -2,9 +2,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "output.h"
 #include "vm.h"
 
-Label label_new(VirtualMachine *vm, string name, usize ip) {
+Label label_new(VirtualMachine *vm, Symbol name, usize ip) {
     Label label;
     label.label_id = vec_len(&vm->labels);
     label.name = name;
@@ -12,14 +13,21 @@ Label label_new(VirtualMachine *vm, string name, usize ip) {
     return label;
 }
 
-VirtualMachine *vm_new(void) {
+VirtualMachine *vm_new(Interner *symbols) {
     VirtualMachine *vm = malloc(sizeof(VirtualMachine));
     vm->state = VM_STATE_RUNNING;
-    vec_init(&vm->instructions);
+    vec_init_tag(&vm->code, MEM_VM);
+    vec_init_tag(&vm->constants, MEM_VM);
     for (int i = 0; i < REG_COUNT; i++)
         vm->registers[i] = NONE_VALUE;
-    vec_init(&vm->labels);
-    vec_init(&vm->stack);
+    vec_init_tag(&vm->labels, MEM_VM);
+    map_init(&vm->label_names, MAP_KEY_U32, MEM_VM);
+    map_init(&vm->label_ips, MAP_KEY_U32, MEM_VM);
+    vm->symbols = symbols;
+    vm->linked = false;
+    vm->verified = false;
+    vm->trace = NULL;
+    vec_init_tag(&vm->stack, MEM_VM);
     vm->sp = 0;
     vm->bp = 0;
     vm->ip = 0;
@@ -27,12 +35,39 @@ VirtualMachine *vm_new(void) {
 }
 
 void vm_free(VirtualMachine *vm) {
-    for (usize i = 0; i < vec_len(&vm->instructions); i++)
-        instruction_free(*vec_get(&vm->instructions, i));
-    vec_free(&vm->instructions);
+    vec_free(&vm->code);
+    vec_free(&vm->constants);
+    vec_free(&vm->labels);
+    map_free(&vm->label_names);
+    map_free(&vm->label_ips);
+    vec_free(&vm->stack);
+    vm_trace_stop(vm);
     free(vm);
 }
 
+static inline Value vm_unpack_operand(VirtualMachine *vm, OperandMode mode,
+                                      Register reg, u32 arg) {
+    switch (mode) {
+    case OPERAND_NONE:
+        return NONE_VALUE;
+    case OPERAND_REGISTER:
+        return REG_VALUE(reg);
+    case OPERAND_IMMEDIATE:
+        return IMM_VALUE((i32)arg);
+    case OPERAND_CONSTANT:
+        return IMM_VALUE(*vec_get(&vm->constants, arg));
+    case OPERAND_LABEL:
+        return LABEL_VALUE(arg);
+    case OPERAND_ADDRESS:
+        return ADDRESS_VALUE(arg);
+    }
+    return NONE_VALUE;
+}
+#define VM_OPERAND1(vm, p)                                                     \
+    vm_unpack_operand(vm, PACKED_MODE1(p), PACKED_REG1(p), (p)->arg)
+#define VM_OPERAND2(vm, p)                                                     \
+    vm_unpack_operand(vm, PACKED_MODE2(p), PACKED_REG2(p), (p)->arg)
+
 Value vm_resolve_value(VirtualMachine *vm, Value value) {
     switch (value.type) {
     case VALUE_NONE: {
@@ -45,398 +80,786 @@ Value vm_resolve_value(VirtualMachine *vm, Value value) {
         return value;
     }
     case VALUE_LABEL: {
-        Label *label = vm_find_label_by_name(vm, value.data.label);
-        if (label) {
-            return IMM_VALUE(label->ip);
-        }
+        // Labels only survive in programs that failed to link.
+        return NONE_VALUE;
+    }
+    case VALUE_ADDRESS: {
+        return IMM_VALUE(value.data.address);
     }
     }
     return NONE_VALUE;
 }
 
-static void vm_dump_value(Value value) {
+static void vm_dump_value(VirtualMachine *vm, Output *out, Value value) {
     switch (value.type) {
     case VALUE_NONE: {
-        printf("none");
+        output_sv(out, SV("none"));
     } break;
     case VALUE_REGISTER: {
-        printf("r%d", value.data.reg);
+        output_printf(out, "r%d", value.data.reg);
     } break;
     case VALUE_IMMEDIATE: {
-        printf("%f", value.data.imm);
+        output_printf(out, "%f", value.data.imm);
     } break;
     case VALUE_LABEL: {
-        printf(SV_FMT, SV_ARG(value.data.label));
+        output_sv(out, interner_get(vm->symbols, value.data.label));
+    } break;
+    case VALUE_ADDRESS: {
+        Label *label = vm_find_label_by_ip(vm, value.data.address);
+        if (label != NULL)
+            output_sv(out, interner_get(vm->symbols, label->name));
+        else
+            output_printf(out, "@%zu", value.data.address);
     } break;
     }
 }
 
+// How the trace names an opcode; the same as the old debug output.
+static const char *vm_trace_opcode_name(Opcode opcode) {
+    switch (opcode) {
+    case OP_NOP:
+        return "NOP";
+    case OP_MOV:
+        return "MOV";
+    case OP_PUSH:
+        return "PUSH";
+    case OP_POP:
+        return "POP";
+    case OP_ADD:
+        return "ADD";
+    case OP_SUB:
+        return "SUB";
+    case OP_MUL:
+        return "MUL";
+    case OP_DIV:
+        return "DIV";
+    case OP_MOD:
+        return "MOD";
+    case OP_JMP:
+        return "JMP";
+    case OP_HLT:
+        return "HLT";
+    }
+    return "???";
+}
+
+void vm_trace_start(VirtualMachine *vm, usize capacity) {
+    vm_trace_stop(vm);
+    usize size = 1;
+    while (size < capacity)
+        size *= 2;
+    Trace *trace = mem_alloc(MEM_VM, sizeof(*trace));
+    trace->entries = mem_alloc(MEM_VM, size * sizeof(*trace->entries));
+    trace->capacity = size;
+    trace->count = 0;
+    vm->trace = trace;
+}
+
+void vm_trace_stop(VirtualMachine *vm) {
+    Trace *trace = vm->trace;
+    if (trace == NULL)
+        return;
+    mem_free(MEM_VM, trace->entries,
+             trace->capacity * sizeof(*trace->entries));
+    mem_free(MEM_VM, trace, sizeof(*trace));
+    vm->trace = NULL;
+}
+
+static inline void vm_trace_record(VirtualMachine *vm, Opcode opcode,
+                                   Value operand1, Value operand2) {
+    Trace *trace = vm->trace;
+    TraceEntry *entry =
+        &trace->entries[trace->count++ & (trace->capacity - 1)];
+    entry->ip = (u32)vm->ip;
+    entry->opcode = opcode;
+    entry->operand1 = operand1;
+    entry->operand2 = operand2;
+}
+
+void vm_trace_dump(VirtualMachine *vm, Output *out) {
+    Trace *trace = vm->trace;
+    if (trace == NULL)
+        return;
+    usize first =
+        trace->count > trace->capacity ? trace->count - trace->capacity : 0;
+    for (usize i = first; i < trace->count; i++) {
+        TraceEntry *entry = &trace->entries[i & (trace->capacity - 1)];
+        output_printf(out, "%s", vm_trace_opcode_name(entry->opcode));
+        if (entry->operand1.type != VALUE_NONE) {
+            output_sv(out, SV(" "));
+            vm_dump_value(vm, out, entry->operand1);
+        }
+        if (entry->operand2.type != VALUE_NONE) {
+            output_sv(out, SV(", "));
+            vm_dump_value(vm, out, entry->operand2);
+        }
+        output_sv(out, SV("\n"));
+    }
+}
+
+void vm_link(VirtualMachine *vm) {
+    bool ok = true;
+    for (usize i = 0; i < vec_len(&vm->code); i++) {
+        PackedInstruction *instr = vec_get(&vm->code, i);
+        // Jumps may land on the sentinel at the end, but not past it.
+        if ((PACKED_MODE1(instr) == OPERAND_ADDRESS ||
+             PACKED_MODE2(instr) == OPERAND_ADDRESS) &&
+            instr->arg > vec_len(&vm->code)) {
+            output_printf(&output_stderr,
+                          "error: address %u is outside the program in "
+                          "instruction %zu\n",
+                          instr->arg, i);
+            ok = false;
+            continue;
+        }
+
+        // Only one operand can be a label, since a label is kept in `arg`.
+        u8 shift;
+        if (PACKED_MODE1(instr) == OPERAND_LABEL)
+            shift = 0;
+        else if (PACKED_MODE2(instr) == OPERAND_LABEL)
+            shift = 4;
+        else
+            continue;
+
+        Label *label = vm_find_label_by_name(vm, instr->arg);
+        if (label == NULL) {
+            output_printf(&output_stderr,
+                          "error: undefined label '" SV_FMT "' in "
+                          "instruction %zu\n",
+                          SV_ARG(interner_get(vm->symbols, instr->arg)), i);
+            ok = false;
+            continue;
+        }
+        instr->modes = (u8)((instr->modes & ~(0xF << shift)) |
+                            (OPERAND_ADDRESS << shift));
+        instr->arg = (u32)label->ip;
+    }
+    if (!ok)
+        vm->state = VM_STATE_ERROR;
+    vm->linked = true;
+}
+
+// Checks the operand types of the instruction at `ip` and rewrites it into
+// its specialized form. Immediates move to the constant pool, where the
+// specialized handlers expect them.
+static bool vm_verify_instruction(VirtualMachine *vm, usize ip) {
+    PackedInstruction *instr = vec_get(&vm->code, ip);
+    OperandMode mode1 = PACKED_MODE1(instr);
+    OperandMode mode2 = PACKED_MODE2(instr);
+    bool reg1 = mode1 == OPERAND_REGISTER;
+    bool reg2 = mode2 == OPERAND_REGISTER;
+    bool imm1 = mode1 == OPERAND_IMMEDIATE || mode1 == OPERAND_CONSTANT;
+    bool imm2 = mode2 == OPERAND_IMMEDIATE || mode2 == OPERAND_CONSTANT;
+
+    const char *expected = NULL;
+    Value got = NONE_VALUE;
+    Opcode opcode = opcode_generic(instr->opcode);
+    switch (opcode) {
+    case OP_NOP:
+    case OP_HLT:
+        break;
+    case OP_MOV:
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_DIV:
+    case OP_MOD: {
+        if (!reg1) {
+            expected = "register";
+            got = VM_OPERAND1(vm, instr);
+        } else if (!reg2 && !imm2) {
+            expected = "register or immediate";
+            got = VM_OPERAND2(vm, instr);
+        } else {
+            // Each _RR form is followed by its _RI and _RK forms, and those
+            // for ADD to MOD are in the same order as the generic opcodes.
+            Opcode rr = opcode == OP_MOV ? OP_MOV_RR
+                                         : OP_ADD_RR + 3 * (opcode - OP_ADD);
+            if (reg2)
+                opcode = rr;
+            else
+                opcode = mode2 == OPERAND_IMMEDIATE ? rr + 1 : rr + 2;
+        }
+    } break;
+    case OP_PUSH: {
+        if (!reg1 && !imm1) {
+            expected = "register or immediate";
+            got = VM_OPERAND1(vm, instr);
+        } else {
+            if (reg1)
+                opcode = OP_PUSH_R;
+            else
+                opcode = mode1 == OPERAND_IMMEDIATE ? OP_PUSH_I : OP_PUSH_K;
+        }
+    } break;
+    case OP_POP: {
+        if (!reg1) {
+            expected = "register";
+            got = VM_OPERAND1(vm, instr);
+        } else {
+            opcode = OP_POP_R;
+        }
+    } break;
+    case OP_JMP: {
+        if (mode1 != OPERAND_ADDRESS) {
+            expected = "address";
+            got = VM_OPERAND1(vm, instr);
+        } else {
+            opcode = OP_JMP_A;
+        }
+    } break;
+    default: {
+        output_printf(&output_stderr,
+                      "error: instruction %zu: opcode %u is not supported\n",
+                      ip, instr->opcode);
+        return false;
+    }
+    }
+
+    if (expected != NULL) {
+        output_printf(&output_stderr,
+                      "error: instruction %zu: expected %s, got %s\n", ip,
+                      expected, value_to_string(got));
+        return false;
+    }
+
+    instr->opcode = opcode;
+    return true;
+}
+
+// The registers a specialized instruction reads and writes, as masks.
+static void vm_register_effects(PackedInstruction *instr, u32 *reads,
+                                u32 *writes) {
+    u32 r1 = 1u << PACKED_REG1(instr);
+    u32 r2 = 1u << PACKED_REG2(instr);
+    *reads = 0;
+    *writes = 0;
+    switch (instr->opcode) {
+    case OP_MOV_RR: {
+        *reads = r2;
+        *writes = r1;
+    } break;
+    case OP_MOV_RI:
+    case OP_MOV_RK:
+    case OP_POP_R: {
+        *writes = r1;
+    } break;
+    case OP_ADD_RR:
+    case OP_SUB_RR:
+    case OP_MUL_RR:
+    case OP_DIV_RR:
+    case OP_MOD_RR: {
+        *reads = r1 | r2;
+    } break;
+    case OP_ADD_RI:
+    case OP_ADD_RK:
+    case OP_SUB_RI:
+    case OP_SUB_RK:
+    case OP_MUL_RI:
+    case OP_MUL_RK:
+    case OP_DIV_RI:
+    case OP_DIV_RK:
+    case OP_MOD_RI:
+    case OP_MOD_RK:
+    case OP_PUSH_R: {
+        *reads = r1;
+    } break;
+    }
+}
+
+// Works out which registers are set on every path to each reachable
+// instruction, starting from the ones that are set now, and reports every
+// read of a register that may not be.
+static bool vm_verify_registers(VirtualMachine *vm) {
+    const u32 unvisited = (u32)-1;
+    usize count = vec_len(&vm->code);
+
+    u32 entry = 0;
+    for (usize i = 0; i < REG_COUNT; i++)
+        if (vm->registers[i].type != VALUE_NONE)
+            entry |= 1u << i;
+
+    // `set[i]` is the mask on entry to instruction i; `count` is the end.
+    vec(u32) set;
+    vec_init_tag(&set, MEM_VM);
+    vec_resize(&set, count + 1);
+    for (usize i = 0; i <= count; i++)
+        *vec_get(&set, i) = unvisited;
+    vec(u32) worklist;
+    vec_init_tag(&worklist, MEM_VM);
+
+    // Programs are entered at the start, or wherever `ip` was left.
+    *vec_get(&set, 0) = entry;
+    vec_push(&worklist, 0);
+    if (vm->ip != 0 && vm->ip <= count) {
+        *vec_get(&set, vm->ip) = entry;
+        vec_push(&worklist, (u32)vm->ip);
+    }
+    while (vec_len(&worklist) > 0) {
+        u32 ip = vec_pop(&worklist);
+        if (ip == count)
+            continue;
+        PackedInstruction *instr = vec_get(&vm->code, ip);
+        u32 reads, writes;
+        vm_register_effects(instr, &reads, &writes);
+        u32 out = *vec_get(&set, ip) | writes;
+        if (instr->opcode == OP_HLT)
+            continue;
+
+        // No verified instruction has more than one successor yet.
+        u32 next = instr->opcode == OP_JMP_A ? instr->arg : ip + 1;
+        u32 *in = vec_get(&set, next);
+        u32 merged = *in == unvisited ? out : *in & out;
+        if (merged != *in) {
+            *in = merged;
+            vec_push(&worklist, next);
+        }
+    }
+
+    bool ok = true;
+    for (usize ip = 0; ip < count; ip++) {
+        u32 in = *vec_get(&set, ip);
+        if (in == unvisited)
+            continue;
+        u32 reads, writes;
+        vm_register_effects(vec_get(&vm->code, ip), &reads, &writes);
+        for (usize r = 0; r < REG_COUNT; r++) {
+            if ((reads & ~in) & (1u << r)) {
+                output_printf(&output_stderr,
+                              "error: instruction %zu: r%zu may be read "
+                              "before it is set\n",
+                              ip, r);
+                ok = false;
+            }
+        }
+    }
+
+    vec_free(&set);
+    vec_free(&worklist);
+    return ok;
+}
+
+void vm_verify(VirtualMachine *vm) {
+    if (!vm->linked)
+        vm_link(vm);
+    if (vm->state == VM_STATE_ERROR)
+        return;
+
+    bool ok = true;
+    for (usize i = 0; i < vec_len(&vm->code); i++)
+        ok &= vm_verify_instruction(vm, i);
+    if (ok)
+        ok = vm_verify_registers(vm);
+
+    if (!ok)
+        vm->state = VM_STATE_ERROR;
+    vm->verified = ok;
+}
+
+// Handlers run verified programs, so they read their operands without
+// checking them.
+#define VM_REG2(vm, p) ((vm)->registers[PACKED_REG2(p)])
+#define VM_IMMEDIATE(p) IMM_VALUE((double)(i32)(p)->arg)
+#define VM_CONSTANT(vm, p) IMM_VALUE(*vec_get(&(vm)->constants, (p)->arg))
+
+// Records the instruction about to run, if tracing is on.
+#define VM_TRACE(opcode, operand1, operand2)                                   \
+    do {                                                                       \
+        if (vm->trace != NULL)                                                 \
+            vm_trace_record(vm, opcode, operand1, operand2);                   \
+    } while (0)
+
+// The _RR, _RI and _RK handlers of `op`, which applies `apply` to `dst`,
+// the first register's value, and `src`, the second operand.
+#define VM_ARITHMETIC_HANDLER(op, form, operand, apply)                        \
+    VM_HANDLER(op##form) {                                                     \
+        Value src = operand;                                                   \
+        double *dst = &vm->registers[PACKED_REG1(instr)].data.imm;             \
+        VM_TRACE(op, REG_VALUE(PACKED_REG1(instr)), src);                      \
+        apply;                                                                 \
+        vm->ip++;                                                              \
+    }                                                                          \
+    VM_NEXT();
+#define VM_ARITHMETIC_HANDLERS(op, apply)                                      \
+    VM_ARITHMETIC_HANDLER(op, _RR, VM_REG2(vm, instr), apply)                  \
+    VM_ARITHMETIC_HANDLER(op, _RI, VM_IMMEDIATE(instr), apply)                 \
+    VM_ARITHMETIC_HANDLER(op, _RK, VM_CONSTANT(vm, instr), apply)
+
+// Every handler ends in VM_NEXT, which fetches the instruction at `ip` and
+// goes to its handler. With computed gotos each handler has an indirect
+// jump of its own, which the branch predictor can tell apart; the switch
+// funnels them all through one. Programs end in an OP_END sentinel and
+// halting and errors return from their handlers, so no step checks the
+// bounds or the state.
+#if !defined(__GNUC__) && !defined(VM_SWITCH_DISPATCH)
+#define VM_SWITCH_DISPATCH
+#endif
+
+#ifdef VM_SWITCH_DISPATCH
+#define VM_HANDLER(op) case op:
+#define VM_HANDLER_DEFAULT default:
+#define VM_NEXT() continue
+#else
+#define VM_HANDLER(op) vm_##op:
+#define VM_HANDLER_DEFAULT vm_unknown:
+#define VM_NEXT()                                                              \
+    do {                                                                       \
+        instr = vec_get(&vm->code, vm->ip);                                    \
+        goto *handlers[instr->opcode];                                         \
+    } while (0)
+
+// Labels as values and designated ranges are GNU extensions, and the
+// handler table overrides its default on purpose.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#pragma GCC diagnostic ignored "-Woverride-init"
+#endif
+
 void vm_execute(VirtualMachine *vm) {
+    if (!vm->verified)
+        vm_verify(vm);
+    if (vm->state != VM_STATE_RUNNING)
+        return;
+
+    // The sentinel sits just past the end, where the next emit will
+    // overwrite it.
+    vec_reserve(&vm->code, 1);
+    vm->code.data[vec_len(&vm->code)] = (PackedInstruction){OP_END, 0, 0, 0};
+
+    PackedInstruction *instr;
+#ifdef VM_SWITCH_DISPATCH
     for (;;) {
-        if (vm->ip >= vec_len(&vm->instructions))
-            return;
-        if (vm->state != VM_STATE_RUNNING)
-            return;
-        Instruction *instr = *vec_get(&vm->instructions, vm->ip);
+        instr = vec_get(&vm->code, vm->ip);
         switch (instr->opcode) {
-        case OP_NOP: {
-#ifdef VM_DEBUG
-            printf("NOP\n");
-#endif
-            vm->ip++;
-        } break;
-        case OP_MOV: {
-            Value operand1 = instr->operand1;
-            Value operand2 = instr->operand2;
-            VM_ASSERT(vm, operand1.type == VALUE_REGISTER,
-                      "Expected register, got %s", value_to_string(operand1));
-            VM_ASSERT(vm,
-                      operand2.type == VALUE_REGISTER ||
-                          operand2.type == VALUE_IMMEDIATE,
-                      "Expected register or immediate, got %s",
-                      value_to_string(operand2));
-
-            operand2 = vm_resolve_value(vm, operand2);
-            VM_ASSERT(vm, operand2.type != VALUE_NONE, "Invalid value, got %s",
-                      value_to_string(operand2));
-
-            vm->registers[operand1.data.reg] = operand2;
-#ifdef VM_DEBUG
-            printf("MOV ");
-            vm_dump_value(operand1);
-            printf(", ");
-            vm_dump_value(operand2);
-            printf("\n");
+#else
+    // Built once; unknown opcodes go to vm_unknown.
+    static void *const handlers[256] = {
+        [0 ... 255] = &&vm_unknown,
+        [OP_NOP] = &&vm_OP_NOP,
+        [OP_MOV_RR] = &&vm_OP_MOV_RR,
+        [OP_MOV_RI] = &&vm_OP_MOV_RI,
+        [OP_MOV_RK] = &&vm_OP_MOV_RK,
+        [OP_ADD_RR] = &&vm_OP_ADD_RR,
+        [OP_ADD_RI] = &&vm_OP_ADD_RI,
+        [OP_ADD_RK] = &&vm_OP_ADD_RK,
+        [OP_SUB_RR] = &&vm_OP_SUB_RR,
+        [OP_SUB_RI] = &&vm_OP_SUB_RI,
+        [OP_SUB_RK] = &&vm_OP_SUB_RK,
+        [OP_MUL_RR] = &&vm_OP_MUL_RR,
+        [OP_MUL_RI] = &&vm_OP_MUL_RI,
+        [OP_MUL_RK] = &&vm_OP_MUL_RK,
+        [OP_DIV_RR] = &&vm_OP_DIV_RR,
+        [OP_DIV_RI] = &&vm_OP_DIV_RI,
+        [OP_DIV_RK] = &&vm_OP_DIV_RK,
+        [OP_MOD_RR] = &&vm_OP_MOD_RR,
+        [OP_MOD_RI] = &&vm_OP_MOD_RI,
+        [OP_MOD_RK] = &&vm_OP_MOD_RK,
+        [OP_PUSH_R] = &&vm_OP_PUSH_R,
+        [OP_PUSH_I] = &&vm_OP_PUSH_I,
+        [OP_PUSH_K] = &&vm_OP_PUSH_K,
+        [OP_POP_R] = &&vm_OP_POP_R,
+        [OP_JMP_A] = &&vm_OP_JMP_A,
+        [OP_HLT] = &&vm_OP_HLT,
+        [OP_END] = &&vm_OP_END,
+    };
+    VM_NEXT();
 #endif
+        VM_HANDLER(OP_NOP) {
+            VM_TRACE(OP_NOP, NONE_VALUE, NONE_VALUE);
             vm->ip++;
-        } break;
-        case OP_PUSH: {
-            Value operand1 = instr->operand1;
-            VM_ASSERT(vm,
-                      operand1.type == VALUE_REGISTER ||
-                          operand1.type == VALUE_IMMEDIATE,
-                      "Expected register or immediate, got %s",
-                      value_to_string(operand1));
-
-            operand1 = vm_resolve_value(vm, operand1);
-            VM_ASSERT(vm, operand1.type != VALUE_NONE, "Invalid value, got %s",
-                      value_to_string(operand1));
-
-            vec_push(&vm->stack, operand1);
-            vm->sp++;
-#ifdef VM_DEBUG
-            printf("PUSH ");
-            vm_dump_value(operand1);
-            printf("\n");
-#endif
+        }
+        VM_NEXT();
+        VM_HANDLER(OP_MOV_RR) {
+            Value value = VM_REG2(vm, instr);
+            VM_TRACE(OP_MOV, REG_VALUE(PACKED_REG1(instr)), value);
+            vm->registers[PACKED_REG1(instr)] = value;
             vm->ip++;
-        } break;
-        case OP_POP: {
-            Value operand1 = instr->operand1;
-            VM_ASSERT(vm, operand1.type == VALUE_REGISTER,
-                      "Expected register, got %s", value_to_string(operand1));
-            Register reg = operand1.data.reg;
-            VM_ASSERT_NOVARARG(vm, vm->sp > 0, "Stack underflow");
-            vm->registers[reg] = vec_pop(&vm->stack);
-            vm->sp--;
-#ifdef VM_DEBUG
-            printf("POP ");
-            vm_dump_value(operand1);
-            printf("\n");
-#endif
+        }
+        VM_NEXT();
+        VM_HANDLER(OP_MOV_RI) {
+            Value value = VM_IMMEDIATE(instr);
+            VM_TRACE(OP_MOV, REG_VALUE(PACKED_REG1(instr)), value);
+            vm->registers[PACKED_REG1(instr)] = value;
             vm->ip++;
-        } break;
-        case OP_ADD: {
-            Value operand1 = instr->operand1;
-            Value operand2 = instr->operand2;
-            VM_ASSERT(vm, operand1.type == VALUE_REGISTER,
-                      "Expected register, got %s", value_to_string(operand1));
-            VM_ASSERT(vm,
-                      operand2.type == VALUE_REGISTER ||
-                          operand2.type == VALUE_IMMEDIATE,
-                      "Expected register or immediate, got %s",
-                      value_to_string(operand2));
-
-            operand2 = vm_resolve_value(vm, operand2);
-            VM_ASSERT(vm, operand2.type != VALUE_NONE, "Invalid value, got %s",
-                      value_to_string(operand2));
-
-            Register reg = operand1.data.reg;
-            vm->registers[reg].data.imm += operand2.data.imm;
-#ifdef VM_DEBUG
-            printf("ADD ");
-            vm_dump_value(operand1);
-            printf(", ");
-            vm_dump_value(operand2);
-            printf("\n");
-#endif
+        }
+        VM_NEXT();
+        VM_HANDLER(OP_MOV_RK) {
+            Value value = VM_CONSTANT(vm, instr);
+            VM_TRACE(OP_MOV, REG_VALUE(PACKED_REG1(instr)), value);
+            vm->registers[PACKED_REG1(instr)] = value;
             vm->ip++;
-        } break;
-        case OP_SUB: {
-            Value operand1 = instr->operand1;
-            Value operand2 = instr->operand2;
-            VM_ASSERT(vm, operand1.type == VALUE_REGISTER,
-                      "Expected register, got %s", value_to_string(operand1));
-            VM_ASSERT(vm,
-                      operand2.type == VALUE_REGISTER ||
-                          operand2.type == VALUE_IMMEDIATE,
-                      "Expected register or immediate, got %s",
-                      value_to_string(operand2));
-
-            operand2 = vm_resolve_value(vm, operand2);
-            VM_ASSERT(vm, operand2.type != VALUE_NONE, "Invalid value, got %s",
-                      value_to_string(operand2));
-
-            Register reg = operand1.data.reg;
-            vm->registers[reg].data.imm -= operand2.data.imm;
-#ifdef VM_DEBUG
-            printf("SUB ");
-            vm_dump_value(operand1);
-            printf(", ");
-            vm_dump_value(operand2);
-            printf("\n");
-#endif
+        }
+        VM_NEXT();
+        VM_ARITHMETIC_HANDLERS(OP_ADD, *dst += src.data.imm)
+        VM_ARITHMETIC_HANDLERS(OP_SUB, *dst -= src.data.imm)
+        VM_ARITHMETIC_HANDLERS(OP_MUL, *dst *= src.data.imm)
+        VM_ARITHMETIC_HANDLERS(OP_DIV, *dst /= src.data.imm)
+        VM_ARITHMETIC_HANDLERS(OP_MOD, *dst = fmod(*dst, src.data.imm))
+        VM_HANDLER(OP_PUSH_R) {
+            Value value = vm->registers[PACKED_REG1(instr)];
+            VM_TRACE(OP_PUSH, value, NONE_VALUE);
+            vec_push(&vm->stack, value);
+            vm->sp++;
             vm->ip++;
-        } break;
-        case OP_MUL: {
-            Value operand1 = instr->operand1;
-            Value operand2 = instr->operand2;
-            VM_ASSERT(vm, operand1.type == VALUE_REGISTER,
-                      "Expected register, got %s", value_to_string(operand1));
-            VM_ASSERT(vm,
-                      operand2.type == VALUE_REGISTER ||
-                          operand2.type == VALUE_IMMEDIATE,
-                      "Expected register or immediate, got %s",
-                      value_to_string(operand2));
-
-            operand2 = vm_resolve_value(vm, operand2);
-            VM_ASSERT(vm, operand2.type != VALUE_NONE, "Invalid value, got %s",
-                      value_to_string(operand2));
-
-            Register reg = operand1.data.reg;
-            vm->registers[reg].data.imm *= operand2.data.imm;
-#ifdef VM_DEBUG
-            printf("MUL ");
-            vm_dump_value(operand1);
-            printf(", ");
-            vm_dump_value(operand2);
-            printf("\n");
-#endif
+        }
+        VM_NEXT();
+        VM_HANDLER(OP_PUSH_I) {
+            Value value = VM_IMMEDIATE(instr);
+            VM_TRACE(OP_PUSH, value, NONE_VALUE);
+            vec_push(&vm->stack, value);
+            vm->sp++;
             vm->ip++;
-        } break;
-        case OP_DIV: {
-            Value operand1 = instr->operand1;
-            Value operand2 = instr->operand2;
-            VM_ASSERT(vm, operand1.type == VALUE_REGISTER,
-                      "Expected register, got %s", value_to_string(operand1));
-            VM_ASSERT(vm,
-                      operand2.type == VALUE_REGISTER ||
-                          operand2.type == VALUE_IMMEDIATE,
-                      "Expected register or immediate, got %s",
-                      value_to_string(operand2));
-
-            operand2 = vm_resolve_value(vm, operand2);
-            VM_ASSERT(vm, operand2.type != VALUE_NONE, "Invalid value, got %s",
-                      value_to_string(operand2));
-
-            Register reg = operand1.data.reg;
-            vm->registers[reg].data.imm /= operand2.data.imm;
-#ifdef VM_DEBUG
-            printf("DIV ");
-            vm_dump_value(operand1);
-            printf(", ");
-            vm_dump_value(operand2);
-            printf("\n");
-#endif
+        }
+        VM_NEXT();
+        VM_HANDLER(OP_PUSH_K) {
+            Value value = VM_CONSTANT(vm, instr);
+            VM_TRACE(OP_PUSH, value, NONE_VALUE);
+            vec_push(&vm->stack, value);
+            vm->sp++;
             vm->ip++;
-        } break;
-        case OP_MOD: {
-            Value operand1 = instr->operand1;
-            Value operand2 = instr->operand2;
-            VM_ASSERT(vm, operand1.type == VALUE_REGISTER,
-                      "Expected register, got %s", value_to_string(operand1));
-            VM_ASSERT(vm,
-                      operand2.type == VALUE_REGISTER ||
-                          operand2.type == VALUE_IMMEDIATE,
-                      "Expected register or immediate, got %s",
-                      value_to_string(operand2));
-
-            operand2 = vm_resolve_value(vm, operand2);
-            VM_ASSERT(vm, operand2.type != VALUE_NONE, "Invalid value, got %s",
-                      value_to_string(operand2));
-
-            Register reg = operand1.data.reg;
-            double v = fmod(vm->registers[reg].data.imm, operand2.data.imm);
-            vm->registers[reg].data.imm = v;
-#ifdef VM_DEBUG
-            printf("MOD ");
-            vm_dump_value(operand1);
-            printf(", ");
-            vm_dump_value(operand2);
-            printf("\n");
-#endif
+        }
+        VM_NEXT();
+        VM_HANDLER(OP_POP_R) {
+            VM_TRACE(OP_POP, REG_VALUE(PACKED_REG1(instr)), NONE_VALUE);
+            VM_ASSERT_NOVARARG(vm, vm->sp > 0, "Stack underflow");
+            vm->registers[PACKED_REG1(instr)] = vec_pop(&vm->stack);
+            vm->sp--;
             vm->ip++;
-        } break;
-        case OP_JMP: {
-            Value operand1 = instr->operand1;
-            VM_ASSERT(vm, operand1.type == VALUE_LABEL,
-                      "Expected label, got %s", value_to_string(operand1));
-            string label_name = AS_LABEL(operand1);
-            Label *label = vm_find_label_by_name(vm, label_name);
-            VM_ASSERT(vm, label != NULL, "Label not found: " SV_FMT,
-                      SV_ARG(label_name));
-#ifdef VM_DEBUG
-            printf("JMP ");
-            vm_dump_value(operand1);
-            printf("\n");
-#endif
-            vm->ip = label->ip;
-        } break;
-        case OP_HLT: {
-#ifdef VM_DEBUG
-            printf("HLT\n");
-#endif
+        }
+        VM_NEXT();
+        VM_HANDLER(OP_JMP_A) {
+            VM_TRACE(OP_JMP, ADDRESS_VALUE(instr->arg), NONE_VALUE);
+            vm->ip = instr->arg;
+        }
+        VM_NEXT();
+        VM_HANDLER(OP_HLT) {
+            VM_TRACE(OP_HLT, NONE_VALUE, NONE_VALUE);
             vm->state = VM_STATE_HALT;
             return;
         }
-        default: {
+        VM_HANDLER(OP_END) {
+            // Ran off the end of the program.
+            return;
+        }
+        VM_HANDLER_DEFAULT {
             UNIMPLEMENTED_MSG("opcode %u", instr->opcode);
-        } break;
+        }
+#ifdef VM_SWITCH_DISPATCH
         }
     }
+#endif
 }
 
-void vm_emit(VirtualMachine *vm, Instruction *instr) {
-    vec_push(&vm->instructions, instr);
+#ifndef VM_SWITCH_DISPATCH
+#pragma GCC diagnostic pop
+#endif
+
+const char *vm_dispatch_name(void) {
+#ifdef VM_SWITCH_DISPATCH
+    return "switch";
+#else
+    return "threaded";
+#endif
 }
 
+// Stores `value` as operand `n` (0 or 1) of `packed`.
+static void vm_pack_operand(VirtualMachine *vm, PackedInstruction *packed,
+                            u8 n, Value value) {
+    OperandMode mode = OPERAND_NONE;
+    u32 arg = 0;
+    switch (value.type) {
+    case VALUE_NONE: {
+        mode = OPERAND_NONE;
+    } break;
+    case VALUE_REGISTER: {
+        mode = OPERAND_REGISTER;
+        packed->regs |= (u8)(value.data.reg << (4 * n));
+    } break;
+    case VALUE_IMMEDIATE: {
+        // Integers that fit in 32 bits are stored inline; fractions, large
+        // values, -0.0 and NaN go to the constant pool.
+        double imm = value.data.imm;
+        if (imm >= INT32_MIN && imm <= INT32_MAX && imm == (double)(i32)imm &&
+            !(imm == 0 && signbit(imm))) {
+            mode = OPERAND_IMMEDIATE;
+            arg = (u32)(i32)imm;
+        } else {
+            mode = OPERAND_CONSTANT;
+            arg = (u32)vec_len(&vm->constants);
+            vec_push(&vm->constants, imm);
+        }
+    } break;
+    case VALUE_LABEL: {
+        mode = OPERAND_LABEL;
+        arg = value.data.label;
+    } break;
+    case VALUE_ADDRESS: {
+        ASSERT(value.data.address <= UINT32_MAX, "address %zu is too large",
+               value.data.address);
+        mode = OPERAND_ADDRESS;
+        arg = (u32)value.data.address;
+    } break;
+    }
+
+    if (mode != OPERAND_NONE && mode != OPERAND_REGISTER) {
+        ASSERT(n == 0 || PACKED_MODE1(packed) <= OPERAND_REGISTER,
+               "instruction %zu has two operands that are not registers",
+               vec_len(&vm->code));
+        packed->arg = arg;
+    }
+    packed->modes |= (u8)(mode << (4 * n));
+}
+
+void vm_emit(VirtualMachine *vm, Instruction instr) {
+    ASSERT(vec_len(&vm->code) < UINT32_MAX,
+           "program is too large (%zu instructions)", vec_len(&vm->code));
+    PackedInstruction packed = {instr.opcode, 0, 0, 0};
+    vm_pack_operand(vm, &packed, 0, instr.operand1);
+    vm_pack_operand(vm, &packed, 1, instr.operand2);
+    vec_push(&vm->code, packed);
+    vm->linked = false;
+    vm->verified = false;
+}
+
+Instruction vm_instruction(VirtualMachine *vm, usize ip) {
+    PackedInstruction *packed = vec_get(&vm->code, ip);
+    return instruction_new(opcode_generic(packed->opcode),
+                           VM_OPERAND1(vm, packed),
+                           VM_OPERAND2(vm, packed));
+}
+
+// A label names the next instruction to be emitted.
 void vm_emit_label(VirtualMachine *vm, string label_name) {
-    Label *label = malloc(sizeof(Label));
-    label->name = label_name;
-    label->label_id = vec_len(&vm->labels);
-    label->ip = vm->ip;
-    vec_push(&vm->labels, *label);
+    Label label = label_new(vm, intern(vm->symbols, label_name),
+                            vec_len(&vm->code));
+    u64 index = vec_len(&vm->labels);
+    if (!map_get_u32(&vm->label_names, label.name, NULL))
+        map_put_u32(&vm->label_names, label.name, index);
+    if (!map_get_u32(&vm->label_ips, (u32)label.ip, NULL))
+        map_put_u32(&vm->label_ips, (u32)label.ip, index);
+    vec_push(&vm->labels, label);
+    vm->linked = false;
+    vm->verified = false;
 }
 
 Label *vm_find_label_by_ip(VirtualMachine *vm, usize ip) {
-    for (usize i = 0; i < vec_len(&vm->labels); i++) {
-        Label *label = vec_get(&vm->labels, i);
-        if (label->ip == ip)
-            return label;
-    }
-    return NULL;
+    u64 index;
+    if (!map_get_u32(&vm->label_ips, (u32)ip, &index))
+        return NULL;
+    return vec_get(&vm->labels, index);
 }
 
-Label *vm_find_label_by_name(VirtualMachine *vm, string name) {
-    for (usize i = 0; i < vec_len(&vm->labels); i++) {
-        Label *label = vec_get(&vm->labels, i);
-        if (sv_eq(label->name, name))
-            return label;
-    }
-    return NULL;
+Label *vm_find_label_by_name(VirtualMachine *vm, Symbol name) {
+    u64 index;
+    if (!map_get_u32(&vm->label_names, name, &index))
+        return NULL;
+    return vec_get(&vm->labels, index);
 }
 
 void vm_reset_register(VirtualMachine *vm, Register reg) {
     vm->registers[reg] = NONE_VALUE;
+    vm->verified = false;
 }
 
 void vm_dump(VirtualMachine *vm) {
-    printf("Instructions:\n");
-    for (usize i = 0; i < vec_len(&vm->instructions); i++) {
-        Instruction *instr = *vec_get(&vm->instructions, i);
-        printf("  %llu: ", i);
-        switch (instr->opcode) {
+    output_sv(&output_stdout, SV("Instructions:\n"));
+    for (usize i = 0; i < vec_len(&vm->code); i++) {
+        Instruction instr = vm_instruction(vm, i);
+        output_printf(&output_stdout, "  %zu: ", i);
+        switch (instr.opcode) {
         case OP_NOP: {
-            printf("nop");
+            output_sv(&output_stdout, SV("nop"));
         } break;
         case OP_MOV: {
-            printf("mov ");
-            vm_dump_value(instr->operand1);
-            printf(", ");
-            vm_dump_value(instr->operand2);
+            output_sv(&output_stdout, SV("mov "));
+            vm_dump_value(vm, &output_stdout, instr.operand1);
+            output_sv(&output_stdout, SV(", "));
+            vm_dump_value(vm, &output_stdout, instr.operand2);
         } break;
         case OP_PUSH: {
-            printf("push ");
-            vm_dump_value(instr->operand1);
+            output_sv(&output_stdout, SV("push "));
+            vm_dump_value(vm, &output_stdout, instr.operand1);
         } break;
         case OP_POP: {
-            printf("pop ");
-            vm_dump_value(instr->operand1);
+            output_sv(&output_stdout, SV("pop "));
+            vm_dump_value(vm, &output_stdout, instr.operand1);
         } break;
         case OP_ADD: {
-            printf("add ");
-            vm_dump_value(instr->operand1);
-            printf(", ");
-            vm_dump_value(instr->operand2);
+            output_sv(&output_stdout, SV("add "));
+            vm_dump_value(vm, &output_stdout, instr.operand1);
+            output_sv(&output_stdout, SV(", "));
+            vm_dump_value(vm, &output_stdout, instr.operand2);
         } break;
         case OP_SUB: {
-            printf("sub ");
-            vm_dump_value(instr->operand1);
-            printf(", ");
-            vm_dump_value(instr->operand2);
+            output_sv(&output_stdout, SV("sub "));
+            vm_dump_value(vm, &output_stdout, instr.operand1);
+            output_sv(&output_stdout, SV(", "));
+            vm_dump_value(vm, &output_stdout, instr.operand2);
         } break;
         case OP_MUL: {
-            printf("mul ");
-            vm_dump_value(instr->operand1);
-            printf(", ");
-            vm_dump_value(instr->operand2);
+            output_sv(&output_stdout, SV("mul "));
+            vm_dump_value(vm, &output_stdout, instr.operand1);
+            output_sv(&output_stdout, SV(", "));
+            vm_dump_value(vm, &output_stdout, instr.operand2);
         } break;
         case OP_DIV: {
-            printf("div ");
-            vm_dump_value(instr->operand1);
-            printf(", ");
-            vm_dump_value(instr->operand2);
+            output_sv(&output_stdout, SV("div "));
+            vm_dump_value(vm, &output_stdout, instr.operand1);
+            output_sv(&output_stdout, SV(", "));
+            vm_dump_value(vm, &output_stdout, instr.operand2);
         } break;
         case OP_MOD: {
-            printf("mod ");
-            vm_dump_value(instr->operand1);
-            printf(", ");
-            vm_dump_value(instr->operand2);
+            output_sv(&output_stdout, SV("mod "));
+            vm_dump_value(vm, &output_stdout, instr.operand1);
+            output_sv(&output_stdout, SV(", "));
+            vm_dump_value(vm, &output_stdout, instr.operand2);
         } break;
         case OP_JMP: {
-            printf("jmp ");
-            vm_dump_value(instr->operand1);
+            output_sv(&output_stdout, SV("jmp "));
+            vm_dump_value(vm, &output_stdout, instr.operand1);
         } break;
         case OP_HLT: {
-            printf("hlt");
+            output_sv(&output_stdout, SV("hlt"));
         } break;
         default: {
-            UNIMPLEMENTED_MSG("opcode %u", instr->opcode);
+            UNIMPLEMENTED_MSG("opcode %u", instr.opcode);
         } break;
         }
-        printf("\n");
+        output_sv(&output_stdout, SV("\n"));
     }
-    printf("Labels:\n");
+    output_sv(&output_stdout, SV("Labels:\n"));
     for (usize i = 0; i < vec_len(&vm->labels); i++) {
         Label *label = vec_get(&vm->labels, i);
-        printf("  %llu: " SV_FMT "\n", i, SV_ARG(label->name));
+        output_printf(&output_stdout, "  %zu: " SV_FMT "\n", i,
+                      SV_ARG(interner_get(vm->symbols, label->name)));
     }
-    printf("Registers:\n");
+    output_sv(&output_stdout, SV("Registers:\n"));
     for (usize i = 0; i < REG_COUNT; i++) {
         if (vm->registers[i].type == VALUE_NONE)
             continue;
-        printf("  %lld: ", i);
-        vm_dump_value(vm->registers[i]);
-        printf("\n");
+        output_printf(&output_stdout, "  %zu: ", i);
+        vm_dump_value(vm, &output_stdout, vm->registers[i]);
+        output_sv(&output_stdout, SV("\n"));
     }
-    printf("Stack:\n");
+    output_sv(&output_stdout, SV("Stack:\n"));
     for (usize i = 0; i < vec_len(&vm->stack); i++) {
-        printf("  %llu: ", i);
-        vm_dump_value(*vec_get(&vm->stack, i));
-        printf("\n");
+        output_printf(&output_stdout, "  %zu: ", i);
+        vm_dump_value(vm, &output_stdout, *vec_get(&vm->stack, i));
+        output_sv(&output_stdout, SV("\n"));
     }
-    printf("IP: %llu\n", vm->ip);
-    printf("State: ");
+    output_printf(&output_stdout, "IP: %zu\n", vm->ip);
+    output_sv(&output_stdout, SV("State: "));
     switch (vm->state) {
     case VM_STATE_RUNNING: {
-        printf("running");
+        output_sv(&output_stdout, SV("running"));
     } break;
     case VM_STATE_HALT: {
-        printf("halt");
+        output_sv(&output_stdout, SV("halt"));
     } break;
     case VM_STATE_ERROR: {
-        printf("error");
+        output_sv(&output_stdout, SV("error"));
     } break;
     }
-    printf("\n");
+    output_sv(&output_stdout, SV("\n"));
 }
\ No newline at end of file
@@ -3,13 +3,18 @@
 
 #include "common.h"
 #include "instrucation.h"
+#include "intern.h"
+#include "map.h"
+#include "output.h"
 #include "vector.h"
 
+// Runtime errors go through `output_stderr`, so they come out in order with
+// earlier diagnostics and a trace dump.
 #define VM_ASSERT(vm, cond, msg, ...)                                          \
     do {                                                                       \
         if (!(cond)) {                                                         \
-            fprintf(stderr, "%s:%u: ERROR: " msg "\n", __FILE__, __LINE__,     \
-                    ##__VA_ARGS__);                                            \
+            output_printf(&output_stderr, "%s:%u: ERROR: " msg "\n",           \
+                          __FILE__, __LINE__, ##__VA_ARGS__);                  \
             vm->state = VM_STATE_ERROR;                                        \
             return;                                                            \
         }                                                                      \
@@ -17,7 +22,8 @@
 #define VM_ASSERT_NOVARARG(vm, cond, msg)                                      \
     do {                                                                       \
         if (!(cond)) {                                                         \
-            fprintf(stderr, "%s:%u: ERROR: " msg "\n", __FILE__, __LINE__);    \
+            output_printf(&output_stderr, "%s:%u: ERROR: " msg "\n",           \
+                          __FILE__, __LINE__);                                 \
             vm->state = VM_STATE_ERROR;                                        \
             return;                                                            \
         }                                                                      \
@@ -31,7 +37,7 @@ enum {
 };
 
 typedef struct {
-    string name;
+    Symbol name;
     u8 label_id;
     usize ip;
 } Label;
@@ -41,14 +47,48 @@ typedef struct {
     vec(Instruction *) instructions;
 } Segment;
 
+// An instruction as it was about to run: its ip, its generic opcode and
+// its operands, with the immediate and register values it read.
+typedef struct {
+    u32 ip;
+    Opcode opcode;
+    Value operand1;
+    Value operand2;
+} TraceEntry;
+
+// A ring of the last `capacity` instructions executed. `capacity` is a
+// power of two and `count` is how many have been recorded in all.
+typedef struct {
+    TraceEntry *entries;
+    usize capacity;
+    usize count;
+} Trace;
+
 typedef struct {
     VirtualMachineState state;
 
     // TODO: segments as a replacement for labels?
     // vec(Segment *) segments;
-    vec(Instruction *) instructions;
+    // The program, one packed instruction per entry, and the immediates
+    // that are too wide to be stored inline.
+    vec(PackedInstruction) code;
+    vec(double) constants;
     Value registers[REG_COUNT];
     vec(Label) labels;
+    // Index into `labels` of the first label with a given name, and of the
+    // first label at a given ip.
+    Map label_names;
+    Map label_ips;
+    // Label names are interned here, normally the compiler's symbols.
+    Interner *symbols;
+    // Whether every label operand has been replaced by its address since
+    // the program last changed.
+    bool linked;
+    // Whether `vm_verify` has accepted the program since it, or the
+    // registers it starts from, last changed.
+    bool verified;
+    // NULL unless tracing is on; see `vm_trace_start`.
+    Trace *trace;
 
     vec(Value) stack;
     usize sp, bp;
@@ -56,20 +96,46 @@ typedef struct {
     usize ip;
 } VirtualMachine;
 
-Label label_new(VirtualMachine *vm, string name, usize ip);
+Label label_new(VirtualMachine *vm, Symbol name, usize ip);
 
-VirtualMachine *vm_new(void);
+VirtualMachine *vm_new(Interner *symbols);
 void vm_free(VirtualMachine *vm);
 
 Value vm_resolve_value(VirtualMachine *vm, Value value);
+// Replaces every label operand with the address of its label, so a jump is
+// a plain assignment to `ip`. Undefined labels are all reported together
+// and leave the VM in the error state. `vm_execute` links the program
+// first if it has not been.
+void vm_link(VirtualMachine *vm);
+// Checks every instruction's operand types once, ahead of execution, and
+// rewrites it into the specialized opcode for those types, so handlers do
+// not check them again. Reads of a register that may not have been set on
+// some path are rejected too. Every error is reported and leaves the VM in
+// the error state. `vm_execute` verifies the program first if it has not
+// been.
+void vm_verify(VirtualMachine *vm);
 void vm_execute(VirtualMachine *vm);
+// "threaded" or "switch", whichever dispatch `vm_execute` was built with.
+const char *vm_dispatch_name(void);
 
-void vm_emit(VirtualMachine *vm, Instruction *instr);
+void vm_emit(VirtualMachine *vm, Instruction instr);
+// Unpacks the instruction at `ip`, with its generic opcode.
+Instruction vm_instruction(VirtualMachine *vm, usize ip);
 void vm_emit_label(VirtualMachine *vm, string label_name);
 Label *vm_find_label_by_ip(VirtualMachine *vm, usize ip);
-Label *vm_find_label_by_name(VirtualMachine *vm, string name);
+Label *vm_find_label_by_name(VirtualMachine *vm, Symbol name);
 void vm_reset_register(VirtualMachine *vm, Register reg);
 
 void vm_dump(VirtualMachine *vm);
 
+// Starts recording every instruction executed into a ring that keeps the
+// last `capacity` of them, rounded up to a power of two. Each one costs a
+// 40-byte copy, so tracing can stay on and be dumped when something goes
+// wrong.
+void vm_trace_start(VirtualMachine *vm, usize capacity);
+void vm_trace_stop(VirtualMachine *vm);
+// Prints the recorded instructions, oldest first, one per line, e.g.
+// "ADD r0, 1.000000" with the value the instruction read.
+void vm_trace_dump(VirtualMachine *vm, Output *out);
+
 #endif // _CYCLONE_VM_H
\ No newline at end of file